@@ -50,15 +50,253 @@
 #include <limits.h>
 
 #include "bcbasic.h"
+#ifdef VIDEO_SPI
+#include <SPI.h>
+#endif
+
+// All files of BASIC are opened, read, written, listed, removed and renamed with the host_fs functions below, so that
+// only these functions know which filesystem is used:
+//   SPIFFS                  The default
+//   LittleFS                With BASIC_FS_LITTLEFS. It opens and seeks faster in large files, but the files that are
+//                           uploaded to the ESP, like help.dat, have to be put on the same filesystem.
+//   The files of the host   With BASIC_FS_POSIX, in the directory BASIC_FS_POSIX_ROOT, for running BASIC on a computer
+#ifdef BASIC_FS_POSIX
+#include <dirent.h>
+#include <sys/stat.h>
+#ifndef BASIC_FS_POSIX_ROOT
+#define BASIC_FS_POSIX_ROOT "."
+#endif
+typedef FILE *BasicFsFile;
+struct BasicDir{
+	DIR *dir;
+};
+#else
+#ifdef BASIC_FS_LITTLEFS
+#include <LittleFS.h>
+#define BASIC_FS LittleFS
+#else
+#define BASIC_FS SPIFFS
+#endif
+typedef File BasicFsFile;
+// The files of a directory listing, in the way of the core that is used
+struct BasicDir{
+#ifdef ESP8266
+	Dir dir;
+#endif
+#ifdef ESP32
+	File dir;
+#endif
+};
+#endif
+
+#ifdef BASIC_FS_POSIX
+void host_fsBegin(){
+}
+
+// Mode is "r", "w" or "r+"
+BasicFsFile host_fsOpen(String filename, const char *mode){
+	return fopen((String(BASIC_FS_POSIX_ROOT)+filename).c_str(),(String(mode)+"b").c_str());
+}
+
+bool host_fsExists(String filename){
+	struct stat info;
+	return stat((String(BASIC_FS_POSIX_ROOT)+filename).c_str(),&info)==0;
+}
+
+bool host_fsRemove(String filename){
+	return remove((String(BASIC_FS_POSIX_ROOT)+filename).c_str())==0;
+}
+
+bool host_fsRename(String from, String to){
+	return rename((String(BASIC_FS_POSIX_ROOT)+from).c_str(),(String(BASIC_FS_POSIX_ROOT)+to).c_str())==0;
+}
+
+bool host_fsIsOpen(BasicFsFile *f){
+	return *f!=NULL;
+}
+
+int host_fsRead(BasicFsFile *f, uint8_t *data, int len){
+	return fread(data,1,len,*f);
+}
+
+int host_fsWrite(BasicFsFile *f, const uint8_t *data, int len){
+	return fwrite(data,1,len,*f);
+}
+
+// Also needed between reading and writing a file that was opened with "r+"
+bool host_fsSeek(BasicFsFile *f, int position){
+	return fseek(*f,position,SEEK_SET)==0;
+}
+
+int host_fsSize(BasicFsFile *f){
+	struct stat info;
+	fflush(*f);
+	if(fstat(fileno(*f),&info)!=0){
+		return 0;
+	}
+	return info.st_size;
+}
+
+void host_fsFlush(BasicFsFile *f){
+	fflush(*f);
+}
+
+void host_fsClose(BasicFsFile *f){
+	if(*f!=NULL){
+		fclose(*f);
+		*f=NULL;
+	}
+}
+
+void host_fsOpenDir(BasicDir *d){
+	d->dir=opendir(BASIC_FS_POSIX_ROOT);
+}
+
+bool host_fsNextFile(BasicDir *d, String *filename, int *size){
+	struct dirent *entry;
+	struct stat info;
+	while(d->dir!=NULL && (entry=readdir(d->dir))!=NULL){
+		*filename="/"+String(entry->d_name);
+		if(stat((String(BASIC_FS_POSIX_ROOT)+*filename).c_str(),&info)==0 && S_ISREG(info.st_mode)){
+			*size=info.st_size;
+			return true;
+		}
+	}
+	if(d->dir!=NULL){
+		closedir(d->dir);
+		d->dir=NULL;
+	}
+	return false;
+}
+#else
+// SPIFFS is mounted by magnatic-esp, LittleFS is mounted here
+void host_fsBegin(){
+#ifdef BASIC_FS_LITTLEFS
+	BASIC_FS.begin();
+#endif
+}
+
+// Mode is "r", "w" or "r+"
+BasicFsFile host_fsOpen(String filename, const char *mode){
+	return BASIC_FS.open(filename,mode);
+}
+
+bool host_fsExists(String filename){
+	return BASIC_FS.exists(filename);
+}
+
+bool host_fsRemove(String filename){
+	return BASIC_FS.remove(filename);
+}
+
+bool host_fsRename(String from, String to){
+	return BASIC_FS.rename(from,to);
+}
+
+bool host_fsIsOpen(BasicFsFile *f){
+	return *f;
+}
+
+int host_fsRead(BasicFsFile *f, uint8_t *data, int len){
+	return f->read(data,len);
+}
+
+int host_fsWrite(BasicFsFile *f, const uint8_t *data, int len){
+	return f->write(data,len);
+}
+
+bool host_fsSeek(BasicFsFile *f, int position){
+	return f->seek(position,SeekSet);
+}
+
+int host_fsSize(BasicFsFile *f){
+	return f->size();
+}
+
+void host_fsFlush(BasicFsFile *f){
+	f->flush();
+}
+
+void host_fsClose(BasicFsFile *f){
+	f->close();
+}
+
+void host_fsOpenDir(BasicDir *d){
+#ifdef ESP8266
+	d->dir=BASIC_FS.openDir("/");
+#endif
+#ifdef ESP32
+	d->dir=BASIC_FS.open("/");
+#endif
+}
+
+// Gives the name and the size of the next file, the name starts with '/' like the names that files are opened with.
+// Returns false when there are no more files.
+bool host_fsNextFile(BasicDir *d, String *filename, int *size){
+#ifdef ESP8266
+	if(!d->dir.next()){
+		return false;
+	}
+	*filename=d->dir.fileName();
+	*size=d->dir.fileSize();
+#endif
+#ifdef ESP32
+	File file=d->dir.openNextFile();
+	if(!file){
+		return false;
+	}
+	*filename=String(file.name());
+	*size=file.size();
+	file.close();
+#endif
+	if(!filename->startsWith("/")){ // LittleFS leaves it out
+		*filename="/"+*filename;
+	}
+	return true;
+}
+#endif
+
+// Returns the next byte of a file or -1 at its end
+int host_fsReadByte(BasicFsFile *f){
+	uint8_t c;
+	if(host_fsRead(f,&c,1)!=1){
+		return -1;
+	}
+	return c;
+}
+
+bool host_fsPrint(BasicFsFile *f, String text){
+	return host_fsWrite(f,(const uint8_t*)text.c_str(),text.length())==(int)text.length();
+}
+
+// Opens a file for reading and writing at any position, it is created when it does not exist
+BasicFsFile host_fsOpenReadWrite(String filename){
+	if(!host_fsExists(filename)){
+		BasicFsFile f=host_fsOpen(filename,"w");
+		host_fsClose(&f);
+	}
+	return host_fsOpen(filename,"r+");
+}
 
 #define basicX 80
 #define basicY 60
+#define videoRows 64 // Rows of the character ram of the videocard, used as a ring by hardware scrolling
 
 //char basicScreen[basicX*basicY];
 //char basicScreenColor[basicX*basicY];
 char * basicScreen;
 char * basicScreenColor;
+char * videoPages[2]; // What the two pages of the videocard hold, all videoRows rows. The second page is allocated by the first FLIP
+char * videoPagesColor[2];
+char * videoScreen; // The page that output is written to
+char * videoScreenColor;
+int videoWritePage=0;
+int videoDisplayPage=0;
+unsigned long videoFlipDone=0; // The page that was shown until the last FLIP can be written from this moment on
+int videoRowOffset=0; // Row of the character ram that is shown at the top of the screen
 char lineDirty[basicY];
+#define SCREEN_FLUSH_INTERVAL 20 // Maximum number of ms output waits in basicScreen before it is sent to the videocard
+unsigned long nextScreenFlush=0;
 int hostX=0;
 int hostY=0;
 
@@ -68,29 +306,120 @@ int sysVARSTART, sysVAREND;
 int sysGOSUBSTART, sysGOSUBEND;
 int MEMORY_SIZE;
 char inputMode = 0;
-char inkeyChar = 0;
-bool flashCursor=true;
-unsigned long nextFlashCursorEvent=0;
 char fgColor=COLOR_WHITE;
 char bgColor=COLOR_BLUE;
 bool programRunning=false;
 
 WiFiClient basicOutput;
+// Output to basicOutput is collected and written at a new line, when the buffer is full or when the oldest byte
+// has waited CONSOLE_FLUSH_INTERVAL ms. Writing each character by itself costs a TCP segment per character.
+#define CONSOLE_BUFFER_SIZE 256
+#define CONSOLE_FLUSH_INTERVAL 20
+uint8_t consoleBuffer[CONSOLE_BUFFER_SIZE];
+int consoleLength=0;
+unsigned long consoleFlushDue=0;
+unsigned long consoleBytes=0; // Statistics, shown on /consolestats
+unsigned long consoleWrites=0;
 int freeHeapAfterBasicRun=0;
 unsigned long scriptRuntime=0;
 bool outputEnabled=false;
 String libraryTimeBasic=__TIMESTAMP__;
 String scriptTrigger;
-File basicFile;
-String basicFilename;
-int basicFileReadPosition=0;
-int basicFileWritePosition=0;
-bool basicFileOpen=false;
+// Data files are opened on channels #1..#BASIC_FILE_CHANNELS, commands without a channel use #1.
+// A file stays open from OPEN to CLOSE. Reads come from readBuffer, which holds the bytes from readStart on.
+// Writes are collected in writeBuffer and written to writeStart at CLOSE, RSEEK, WSEEK, the end of a program,
+// when the buffer is full or before the read buffer is filled again.
+// A file that is opened with a record length holds records that GET and PUT read and write by number. The read buffer
+// then also works as a cache of the records around the one that was read last.
+#define BASIC_FILE_CHANNELS 8
+#define BASIC_FILE_MAX_RECORD 255
+#ifdef ESP8266
+#define BASIC_FILE_BUFFER_SIZE 128
+#endif
+#ifdef ESP32
+#define BASIC_FILE_BUFFER_SIZE 256
+#endif
+struct BasicFile{
+	BasicFsFile file;
+	bool open;
+	int recordLength; // 0 when the file was opened without one
+	int readPosition;
+	int writePosition;
+	int size; // Including the bytes in writeBuffer
+	uint8_t readBuffer[BASIC_FILE_BUFFER_SIZE];
+	int readStart;
+	int readLength;
+	uint8_t writeBuffer[BASIC_FILE_BUFFER_SIZE];
+	int writeStart;
+	int writeLength;
+};
+BasicFile basicFiles[BASIC_FILE_CHANNELS];
+void host_fileFlush(BasicFile *f);
+void host_fileFlushAll();
+void host_fileClose(BasicFile *f);
+void host_fileCloseAll();
+void host_fileOpen(BasicFile *f, String filename, int recordLength);
+int host_fileReadByte(BasicFile *f);
+bool host_fileEof(BasicFile *f);
+void host_fileWrite(BasicFile *f, const char *data, int len);
+void host_fileGetRecord(BasicFile *f, int record, char *line);
+void host_filePutRecord(BasicFile *f, int record, const char *text);
+
+// KVPUT, KVGET$ and KVDEL keep keys and their values in KV_FILE. KVPUT and KVDEL add a record at its end: the length
+// of the key, with KV_DELETED set for KVDEL, the length of the value, the key and the value.
+// kvIndex is a hash table with the offset of the last record of every key, it is built from KV_FILE at the first use.
+// A lookup reads the records of the keys with the same hash in its probe sequence, normally just one.
+// When more than half of the file holds records that were replaced, the live records are copied to a new file.
+// KV_FILE is kept as KV_OLD_FILE until the new file has taken its place.
+#define KV_FILE "/basic.kv"
+#define KV_TEMP_FILE "/basic.kv.tmp"
+#define KV_OLD_FILE "/basic.kv.old"
+#define KV_MAX_KEY 32
+#define KV_MAX_VALUE 255
+#define KV_DELETED 128
+#define KV_COMPACT_BYTES 4096 // Replaced records needed before the file is compacted
+#ifdef ESP8266
+#define KV_INDEX_SIZE 256
+#endif
+#ifdef ESP32
+#define KV_INDEX_SIZE 1024
+#endif
+#define KV_MAX_KEYS (KV_INDEX_SIZE*3/4)
+#define KV_EMPTY 0xFFFFFFFF
+#define KV_REMOVED 0xFFFFFFFE
+struct KvSlot{
+	uint32_t offset; // Of the record in KV_FILE, or KV_EMPTY or KV_REMOVED
+	uint16_t hash;
+	uint16_t length; // Of the record
+};
+KvSlot kvIndex[KV_INDEX_SIZE];
+int kvKeys=0;
+int kvUsedSlots=0; // Slots of keys and of removed keys
+BasicFsFile kvFile;
+bool kvInOldFile=false; // KV_OLD_FILE could not be renamed back to KV_FILE, kvFile is KV_OLD_FILE
+bool kvLoaded=false;
+uint32_t kvSize=0;
+uint32_t kvOldBytes=0; // Bytes of records that were replaced or removed
+uint8_t kvRecord[2+KV_MAX_KEY+KV_MAX_VALUE]; // The record that was read or written last
+uint32_t kvRecordOffset=KV_EMPTY;
+bool host_kvPut(const char *key, const char *value);
+void host_kvGet(const char *key, char *value);
+void host_kvDelete(const char *key);
 String basicHttpRecvParamName="value";
 String basicHttpRecvParamValue="";
 bool httpRecvAvailable=false;
-bool httpKeyAvailable=false;
-char httpKey;
+
+// Keys from the keyboard of the videocard and from /httpkey wait in keyQueue until INKEY$, the line input or the
+// check for ESC takes them. The serial driver buffers the keys by interrupt, host_readKeyboard moves them to keyQueue.
+// keyQueueHead is only changed when a key is added and keyQueueTail only when one is taken, so neither side locks.
+// A key that arrives when the queue is full is dropped and counted, see /keystats. ESC still stops the program then.
+// /httpkeys only takes the keys that fit and tells keyboard.html how many that were, so it can send the rest again.
+#define KEY_QUEUE_SIZE 64 // Must be a power of 2
+volatile char keyQueue[KEY_QUEUE_SIZE];
+volatile unsigned int keyQueueHead=0;
+volatile unsigned int keyQueueTail=0;
+volatile bool keyQueueEscDropped=false;
+unsigned long keyQueueOverflows=0;
 
 char string_0[] = "OK";
 char string_1[] = "Bad number";
@@ -119,6 +448,8 @@ char string_23[] = "Error in VAL input";
 char string_24[] = "Bad parameter";
 char string_25[] = "File not open";
 char string_26[] = "Structure larger than 65535 bytes";
+char string_27[] = "File not found";
+char string_28[] = "File write failed";
 
 char* errorTable[] = {
     string_0, string_1, string_2, string_3,
@@ -127,7 +458,8 @@ char* errorTable[] = {
     string_12, string_13, string_14, string_15,
     string_16, string_17, string_18, string_19,
     string_20, string_21, string_22, string_23,
-    string_24, string_25, string_26
+    string_24, string_25, string_26, string_27,
+    string_28
 };
 
 // Host-functions
@@ -155,7 +487,7 @@ unsigned char tokenBuf[TOKEN_BUF_SIZE];
 
 const TokenTableEntry tokenTable[] = {
     {0, 0}, {0, 0}, {0, 0}, {0, 0},
-    {0, 0}, {0, 0}, {0, 0}, {0, 0},
+    {0, 0}, {0, 0}, {0, 0}, {"#", 0},
     {"(", 0}, {")",0}, {"+",0}, {"-",0},
     {"*",0}, {"/",0}, {"=",0}, {">",0},
     {"<",0}, {"<>",0}, {">=",0}, {"<=",0},
@@ -176,13 +508,69 @@ const TokenTableEntry tokenTable[] = {
     {"EOF",0}, {"HTTPRECV$", TKN_RET_TYPE_STR}, {"REBOOT",0}, {"INDEXOF",2|TKN_ARG1_TYPE_STR|TKN_ARG2_TYPE_STR}, {"COUNTOF",2|TKN_ARG1_TYPE_STR|TKN_ARG2_TYPE_STR},
     {"FGCOLOR",TKN_FMT_POST}, {"BGCOLOR",TKN_FMT_POST}, {"SETMEMSIZE", TKN_FMT_POST}, {"SETFG", TKN_FMT_POST}, {"SETBG", TKN_FMT_POST}, {"HELP", 0}, {"HELP2", 0},
     {"HTTPRECV", 0}, {"DATADIR", 0}, {"RSEEK", TKN_FMT_POST}, {"READPOS",0}, {"CHR$", 1|TKN_RET_TYPE_STR}, {"WSEEK", TKN_FMT_POST}, {"READ$",1|TKN_RET_TYPE_STR},
-    {"WRITEPOS",0}, {"HELP3", 0}
+    {"WRITEPOS",0}, {"HELP3", 0}, {"SIN",1}, {"COS",1}, {"ATN",1}, {"SQR",1}, {"EXP",1}, {"LN",1}, {"ABS",1}, {"SGN",1},
+    {"POW",2}, {"HELP4", 0}, {"FLIP", 0}, {"COPYRECT", TKN_FMT_POST}, {"SCROLL", TKN_FMT_POST},
+    {"GET", TKN_FMT_POST}, {"PUT", TKN_FMT_POST}, {"KVPUT", TKN_FMT_POST}, {"KVGET$", 1|TKN_ARG1_TYPE_STR|TKN_RET_TYPE_STR},
+    {"KVDEL", TKN_FMT_POST}, {"BSAVE", TKN_FMT_POST}, {"BLOAD", TKN_FMT_POST},
+    {"SPLIT", 0}, {"FIELD$", 3|TKN_ARG1_TYPE_STR|TKN_ARG2_TYPE_STR|TKN_RET_TYPE_STR}
 };
 
 
+void host_queueKey(char c){
+	if(keyQueueHead-keyQueueTail>=KEY_QUEUE_SIZE){
+		keyQueueOverflows++;
+		if(c==27){
+			keyQueueEscDropped=true;
+		}
+		return;
+	}
+	keyQueue[keyQueueHead&(KEY_QUEUE_SIZE-1)]=c;
+	keyQueueHead++;
+}
+
+// Room for keys in keyQueue
+int host_keyQueueFree(){
+	return KEY_QUEUE_SIZE-(keyQueueHead-keyQueueTail);
+}
+
+// Returns the oldest key in keyQueue or 0 when it is empty
+char host_nextKey(){
+	if(keyQueueTail==keyQueueHead){
+		return 0;
+	}
+	char c=keyQueue[keyQueueTail&(KEY_QUEUE_SIZE-1)];
+	keyQueueTail++;
+	return c;
+}
+
+// Takes ESC and all keys before it from keyQueue, returns false when there is no ESC
+bool host_escPressed(){
+	if(keyQueueEscDropped){
+		keyQueueEscDropped=false;
+		keyQueueTail=keyQueueHead;
+		return true;
+	}
+	for(unsigned int i=keyQueueTail;i!=keyQueueHead;i++){
+		if(keyQueue[i&(KEY_QUEUE_SIZE-1)]==27){
+			keyQueueTail=i+1;
+			return true;
+		}
+	}
+	return false;
+}
+
+String host_keyStats(){
+	String stats="queued="+String(keyQueueHead-keyQueueTail)+"\n";
+	stats+="keys="+String(keyQueueHead)+"\n";
+	stats+="overflows="+String(keyQueueOverflows)+"\n";
+	return stats;
+}
+
+void host_readKeyboard();
+
 char host_getKey(){
-	char c=inkeyChar;
-	inkeyChar=0;
+	host_readKeyboard();
+	char c=host_nextKey();
 	if (c>=32 && c<=127) {
 		return c;
 	}
@@ -712,6 +1100,70 @@ int createArray(char *name, int isString) {
     return 1;
 }
 
+// Creates the string array name(n) from the fields of a string, the string and the separator are on the calculator
+// stack. The fields are copied straight from the stack into the elements, a separator becomes a terminator.
+int splitStrArray(char *name, int *count) {
+    // keep the current stack position, since the strings are read after they are popped
+    int oldSTACKEND = sysSTACKEND;
+    char *sep = stackPopStr();
+    char *line = stackPopStr();
+    int sepLen = strlen(sep);
+    if (sepLen == 0)
+        return ERROR_BAD_PARAMETER;
+    int nameLen = strlen(name);
+    int bytesNeeded = 3;	// len + flags
+    bytesNeeded += nameLen + 1;	// name
+    bytesNeeded += 2 + 2;	// num dims + dim
+    bytesNeeded += strlen(line) + 1;	// elements, each separator makes them sepLen-1 bytes shorter
+    if (bytesNeeded > 65535)
+        return ERROR_STRUCTURE_TO_BIG;
+    // strings and arrays are re-allocated if they already exist
+    unsigned char *p = findVariable(name, VAR_TYPE_STR_ARRAY);
+    if (p != NULL) {
+        // check there will actually be room for the new value
+        int oldVarLen = readLengthFromBuffer(p);
+        if (sysVARSTART - (bytesNeeded - oldVarLen) < oldSTACKEND)
+            return ERROR_OUT_OF_MEMORY;
+        deleteVariableAt(p);
+    }
+    if (sysVARSTART - bytesNeeded < oldSTACKEND)
+        return ERROR_OUT_OF_MEMORY;
+
+    unsigned char *elements = &mem[sysVARSTART - bytesNeeded] + 3 + nameLen + 1 + 4;
+    p = elements;
+    int fields = 1;
+    char *c = line;
+    while (*c) {
+        if (*c == *sep && strncmp(c, sep, sepLen) == 0) {
+            *p++ = 0;
+            c += sepLen;
+            fields++;
+        }
+        else
+            *p++ = *c++;
+    }
+    *p++ = 0;
+    // move the elements up against the other variables when separators made them shorter
+    int unused = &mem[sysVARSTART] - p;
+    if (unused > 0) {
+        memmove(elements + unused, elements, p - elements);
+        bytesNeeded -= unused;
+    }
+    sysVARSTART -= bytesNeeded;
+
+    p = &mem[sysVARSTART];
+    writeLengthToBuffer(bytesNeeded,p);
+    p += 2;
+    *p++ = VAR_TYPE_STR_ARRAY;
+    strcpy((char*)p, name);
+    p += nameLen + 1;
+    writeLengthToBuffer(1,p);
+    p += 2;
+    writeLengthToBuffer(fields,p);
+    *count = fields;
+    return ERROR_NONE;
+}
+
 int _getArrayElemOffset(unsigned char **p, int *pOffset) {
 	//Serial.println("\t_getArrayElemOffset called"); 
     // check for correct dimensionality
@@ -923,6 +1375,160 @@ int gosubStackPop(int *lineNumber, int *stmtNumber) {
     return 1;
 }
 
+/* **************************************************************************
+ * MATH FUNCTIONS
+ * **************************************************************************/
+
+// Numbers in BASIC are floats, so SIN, COS, ATN, EXP and LN use the float functions of libm
+// (sinf, expf, ...) instead of the double ones. Compared with double precision their error is
+// below 1e-7 of the result, about 7 significant digits, and below 4e-8 for SIN and COS.
+// With BASIC_FAST_MATH they use the float kernels below instead: range reduction plus a short
+// polynomial, and a small table for EXP. Their error compared with double precision:
+//   SIN, COS  absolute error < 5e-7 for |x| <= 10000
+//   ATN       absolute error < 2e-7
+//   EXP       relative error < 2e-7
+//   LN        error < 2e-7 * max(1, |LN(x)|)
+//   POW       exact for integer exponents, otherwise relative error < 2e-7 * (1 + |y*LN(x)|)
+// examples/mathbench.bas times the functions on the ESP, so both can be compared there.
+// EXP returns FLT_MAX above 88 instead of infinity.
+// POW is exact for integer exponents (within float range).
+
+#ifdef BASIC_FAST_MATH
+#define MATH_PI			3.14159265358979f
+#define MATH_HALF_PI	1.57079632679490f
+#define MATH_LN2		0.69314718055995f
+#define MATH_LN2_HI		0.693359375f	// ln(2) split in two parts for range reduction
+#define MATH_LN2_LO		-2.12194440054690e-4f
+
+// 2^(i/16) for i = 0..15
+const float mathExp2Table[16] = {
+    1.00000000f, 1.04427378f, 1.09050773f, 1.13878863f,
+    1.18920712f, 1.24185781f, 1.29683955f, 1.35425555f,
+    1.41421356f, 1.47682615f, 1.54221083f, 1.61049033f,
+    1.68179283f, 1.75625216f, 1.83400809f, 1.91520656f
+};
+
+// sin(x) or cos(x), depending on the quadrant offset (0 = sin, 1 = cos)
+float mathSinCos(float x, int quadrantOffset) {
+    // x = k * pi/2 + r with |r| <= pi/4, pi/2 split in two parts to keep r accurate
+    float k = floorf(x * (2.0f / MATH_PI) + 0.5f);
+    float r = (x - k * 1.5703125f) - k * 4.83826794897e-4f;
+    int quadrant = ((int)k + quadrantOffset) & 3;
+    float r2 = r * r;
+    float s = r + r * r2 * (-1.66666667e-1f + r2 * (8.33333333e-3f + r2 * -1.98412698e-4f));
+    float c = 1.0f + r2 * (-0.5f + r2 * (4.16666667e-2f + r2 * (-1.38888889e-3f + r2 * 2.48015873e-5f)));
+    switch (quadrant) {
+    case 0: return s;
+    case 1: return c;
+    case 2: return -s;
+    default: return -c;
+    }
+}
+
+float mathAtn(float x) {
+    bool negative = x < 0;
+    if (negative) x = -x;
+    bool inverted = x > 1.0f;
+    if (inverted) x = 1.0f / x;
+    // atan(x) = pi/6 + atan((x*sqrt(3)-1)/(x+sqrt(3))), brings x down to <= tan(pi/12)
+    float offset = 0.0f;
+    if (x > 0.26794919f) {
+        x = (x * 1.73205081f - 1.0f) / (x + 1.73205081f);
+        offset = MATH_PI / 6.0f;
+    }
+    float x2 = x * x;
+    float a = offset + x + x * x2 * (-3.33333333e-1f + x2 * (2.0e-1f + x2 * (-1.42857143e-1f + x2 * 1.11111111e-1f)));
+    if (inverted) a = MATH_HALF_PI - a;
+    return negative ? -a : a;
+}
+
+float mathExp(float x) {
+    if (x < -87.0f) return 0.0f;
+    if (x > 88.0f) return FLT_MAX;
+    // x = (n*16 + i)/16 * ln2 + r with |r| <= ln2/32
+    float k = floorf(x * (16.0f / MATH_LN2) + 0.5f);
+    float r = (x - k * (MATH_LN2_HI / 16.0f)) - k * (MATH_LN2_LO / 16.0f);
+    int ik = (int)k;
+    int n = ik >> 4;
+    float p = 1.0f + r * (1.0f + r * (0.5f + r * 1.66666667e-1f));
+    return ldexpf(mathExp2Table[ik & 15] * p, n);
+}
+
+// x must be > 0
+float mathLn(float x) {
+    int e;
+    float m = frexpf(x, &e);	// x = m * 2^e, 0.5 <= m < 1
+    if (m < 0.70710678f) {
+        m *= 2.0f;
+        e--;
+    }
+    // ln(m) = 2 * atanh(s) with s = (m-1)/(m+1), |s| <= 0.172
+    float s = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+    float l = 2.0f * s * (1.0f + s2 * (3.33333333e-1f + s2 * (2.0e-1f + s2 * (1.42857143e-1f + s2 * 1.11111111e-1f))));
+    return (float)e * MATH_LN2_HI + ((float)e * MATH_LN2_LO + l);
+}
+
+float mathSin(float x) {
+    return mathSinCos(x, 0);
+}
+
+float mathCos(float x) {
+    return mathSinCos(x, 1);
+}
+#else
+float mathSin(float x) {
+    return sinf(x);
+}
+
+float mathCos(float x) {
+    return cosf(x);
+}
+
+float mathAtn(float x) {
+    return atanf(x);
+}
+
+float mathExp(float x) {
+    if (x > 88.0f) return FLT_MAX;
+    return expf(x);
+}
+
+// x must be > 0
+float mathLn(float x) {
+    return logf(x);
+}
+#endif
+
+// returns ERROR_NONE, ERROR_BAD_PARAMETER or ERROR_EXPR_DIV_ZERO, the result is stored in *result
+int mathPow(float x, float y, float *result) {
+    if (y == floorf(y) && fabsf(y) < 2147483648.0f) {
+        // integer exponent, square and multiply
+        long n = (long)y;
+        bool inverse = n < 0;
+        unsigned long u = inverse ? -n : n;
+        float base = x, r = 1.0f;
+        while (u) {
+            if (u & 1) r *= base;
+            base *= base;
+            u >>= 1;
+        }
+        if (inverse) {
+            if (r == 0.0f) return ERROR_EXPR_DIV_ZERO;
+            r = 1.0f / r;
+        }
+        *result = r;
+        return ERROR_NONE;
+    }
+    if (x < 0.0f) return ERROR_BAD_PARAMETER;
+#ifdef BASIC_FAST_MATH
+    *result = (x == 0.0f) ? 0.0f : mathExp(y * mathLn(x));
+#else
+    *result = powf(x, y);
+#endif
+    return ERROR_NONE;
+}
+
 /* **************************************************************************
  * LEXER
  * **************************************************************************/
@@ -1176,6 +1782,7 @@ int parseSubscriptExpr() {
     getNextToken();
     while(1) {
         numDims++;
+        if (numDims > MAX_ARRAY_DIMS) return ERROR_WRONG_ARRAY_DIMENSIONS;
         int val = expectNumber();
         if (val) return val;	// error
         if (curToken == TOKEN_RBRACKET)
@@ -1191,6 +1798,38 @@ int parseSubscriptExpr() {
     return 0;
 }
 
+// Parses the optional #n in front of the arguments of a file command and sets *f to its channel, #1 without it
+int parseFileChannel(BasicFile **f){
+	*f=&basicFiles[0];
+	if(curToken!=TOKEN_HASH){
+		return 0;
+	}
+	getNextToken();
+	int val=parsePrimary();
+	if(val & ERROR_MASK) return val;
+	if(!IS_TYPE_NUM(val)) return ERROR_EXPR_EXPECTED_NUM;
+	if(executeMode){
+		int channel=(int)stackPopNum();
+		if(channel<1 || channel>BASIC_FILE_CHANNELS){
+			return ERROR_BAD_PARAMETER;
+		}
+		*f=&basicFiles[channel-1];
+	}
+	return 0;
+}
+
+// Like parseFileChannel, followed by a comma when there is a channel
+int parseFileChannelArg(BasicFile **f){
+	bool given=(curToken==TOKEN_HASH);
+	int val=parseFileChannel(f);
+	if(val) return val;
+	if(given){
+		if(curToken!=TOKEN_COMMA) return ERROR_UNEXPECTED_TOKEN;
+		getNextToken();
+	}
+	return 0;
+}
+
 // parse a function call e.g. LEN(a$)
 int parseFnCallExpr() {
 	//Serial.println("\tparseFnCallExpr called"); 
@@ -1200,6 +1839,11 @@ int parseFnCallExpr() {
     // get the required arguments and types from the token table
     if (curToken != TOKEN_LBRACKET) return ERROR_EXPR_MISSING_BRACKET;
     getNextToken();
+    BasicFile *file;
+    if (op == TOKEN_READ) {
+        int val = parseFileChannelArg(&file);
+        if (val) return val;
+    }
 
     int reqdArgs = fnSpec & TKN_ARGS_NUM_MASK;
     int argTypes = (fnSpec & TKN_ARG_MASK) >> TKN_ARG_SHIFT;
@@ -1244,17 +1888,24 @@ int parseFnCallExpr() {
             break;
         case TOKEN_READ:
             {
-				if(basicFileOpen){
-					basicFile=SPIFFS.open(basicFilename,"r");
-					basicFile.seek(basicFileReadPosition,SeekSet);
+				if(file->open){
 					int readSize=(int)stackPopNum();
-					char line[readSize+1];
-					basicFile.readBytes(line,readSize);
-					line[readSize]=0;
-					basicFileReadPosition=basicFile.position();
-					basicFile.close();
-					if (!stackPushStr((char*)line))
+					if(readSize<0){
+						return ERROR_BAD_PARAMETER;
+					}
+					// The characters are read straight onto the calculator stack, like stackPushStr stores a string
+					if(sysSTACKEND+readSize+3>sysVARSTART){
 						return ERROR_OUT_OF_MEMORY;
+					}
+					unsigned char *p=&mem[sysSTACKEND];
+					int length=0;
+					int c;
+					while(length<readSize && (c=host_fileReadByte(file))>=0){
+						p[length++]=c;
+					}
+					p[length++]=0;
+					writeLengthToBuffer(length,p+length);
+					sysSTACKEND+=length+2;
 				}
 				else{
 					return ERROR_FILE_NOT_OPEN;
@@ -1324,6 +1975,18 @@ int parseFnCallExpr() {
 				stackPushStr((char*)response.c_str());
 			}
 			break;
+		case TOKEN_KVGET:
+			{
+				String key=String(stackPopStr());
+				char value[KV_MAX_VALUE+1];
+				value[0]=0;
+				if(key.length()>KV_MAX_KEY)
+					return ERROR_BAD_PARAMETER;
+				host_kvGet(key.c_str(),value);
+				if (!stackPushStr(value))
+					return ERROR_OUT_OF_MEMORY;
+			}
+			break;
 		case TOKEN_INDEXOF:
 			{
 				String big=String(stackPopStr());
@@ -1331,6 +1994,32 @@ int parseFnCallExpr() {
 				stackPushNum((float)(big.indexOf(small)+1));
 			}
 			break;
+		case TOKEN_FIELD:
+			{
+				// The field is found in one pass and cut out of line$ where it is on the stack
+				int n=(int)stackPopNum();
+				char *sep=stackPopStr();
+				char *line=stackGetStr();
+				int sepLen=strlen(sep);
+				if(n<1 || sepLen==0){
+					return ERROR_BAD_PARAMETER;
+				}
+				char *start=line;
+				for(int i=1;i<n && start!=NULL;i++){
+					start=strstr(start,sep);
+					if(start!=NULL){
+						start+=sepLen;
+					}
+				}
+				if(start==NULL){
+					stackMidStr(1,0);
+				}
+				else{
+					char *end=strstr(start,sep);
+					stackMidStr(start-line+1,end==NULL ? strlen(start) : end-start);
+				}
+			}
+			break;
 		case TOKEN_COUNTOF:
 			{
 				String big=String(stackPopStr());
@@ -1344,6 +2033,57 @@ int parseFnCallExpr() {
 				stackPushNum((float)count);
 			}
 			break;
+		case TOKEN_SIN:
+			stackPushNum(mathSin(stackPopNum()));
+			break;
+		case TOKEN_COS:
+			stackPushNum(mathCos(stackPopNum()));
+			break;
+		case TOKEN_ATN:
+			stackPushNum(mathAtn(stackPopNum()));
+			break;
+		case TOKEN_SQR:
+			{
+				float f=stackPopNum();
+				if(f<0){
+					return ERROR_BAD_PARAMETER;
+				}
+				stackPushNum(sqrtf(f));
+			}
+			break;
+		case TOKEN_EXP:
+			stackPushNum(mathExp(stackPopNum()));
+			break;
+		case TOKEN_LN:
+			{
+				float f=stackPopNum();
+				if(f<=0){
+					return ERROR_BAD_PARAMETER;
+				}
+				stackPushNum(mathLn(f));
+			}
+			break;
+		case TOKEN_ABS:
+			stackPushNum(fabsf(stackPopNum()));
+			break;
+		case TOKEN_SGN:
+			{
+				float f=stackPopNum();
+				stackPushNum(f>0 ? 1.0f : (f<0 ? -1.0f : 0.0f));
+			}
+			break;
+		case TOKEN_POW:
+			{
+				float y=stackPopNum();
+				float x=stackPopNum();
+				float result;
+				int error=mathPow(x,y,&result);
+				if(error){
+					return error;
+				}
+				stackPushNum(result);
+			}
+			break;
         default:
             return ERROR_UNEXPECTED_TOKEN;
         }
@@ -1429,14 +2169,20 @@ int parse_RND() {
 
 int parse_READPOS() {
     getNextToken();
-    if (executeMode && !stackPushNum(float(basicFileReadPosition)))
+    BasicFile *file;
+    int val = parseFileChannel(&file);
+    if (val) return val;
+    if (executeMode && !stackPushNum(float(file->readPosition)))
         return ERROR_OUT_OF_MEMORY;
     return TYPE_NUMBER;	
 }
 
 int parse_WRITEPOS() {
     getNextToken();
-    if (executeMode && !stackPushNum(float(basicFileWritePosition)))
+    BasicFile *file;
+    int val = parseFileChannel(&file);
+    if (val) return val;
+    if (executeMode && !stackPushNum(float(file->writePosition)))
         return ERROR_OUT_OF_MEMORY;
     return TYPE_NUMBER;	
 }
@@ -1495,7 +2241,10 @@ int parse_HTTPRECV() {
     return TYPE_STRING;	
 }
 
+void host_flushScreen();
+
 void host_sleep(long ms){
+	host_flushScreen();
 	unsigned long end=millis()+ms;
 	while(millis()<end){
 		yield();
@@ -1510,25 +2259,61 @@ int parse_NEWHTTPRECV(){
 	return TYPE_NUMBER;
 }
 
-int parse_EOF() {
+// SPLIT(line$,sep$,a$()) puts the fields of line$ in a$(1) to a$(n), a$() is created again like DIM does. Returns n.
+int parse_SPLIT() {
     getNextToken();
-    if(executeMode){
-		if(basicFileOpen){
-			basicFile=SPIFFS.open(basicFilename,"r");
-			basicFile.seek(basicFileReadPosition,SeekSet);
-			float eof=basicFile.available() ? 0 : 1;
-			if (executeMode && !stackPushNum(eof)){
-				return ERROR_OUT_OF_MEMORY;
-			}
-			return TYPE_NUMBER;	
-		}
-		else{
-			return ERROR_FILE_NOT_OPEN;
-		}
-	}
-}
-
-int parseUnaryNumExp(){
+    if (curToken != TOKEN_LBRACKET) return ERROR_EXPR_MISSING_BRACKET;
+    getNextToken();
+    for (int i=0; i<2; i++) {
+        int val = parseExpression();
+        if (val & ERROR_MASK) return val;
+        if (!IS_TYPE_STR(val)) return ERROR_EXPR_EXPECTED_STR;
+        if (curToken != TOKEN_COMMA) return ERROR_UNEXPECTED_TOKEN;
+        getNextToken();
+    }
+    char ident[MAX_IDENT_LEN+1];
+    if (curToken != TOKEN_IDENT) return ERROR_UNEXPECTED_TOKEN;
+    if (!isStrIdent) return ERROR_EXPR_EXPECTED_STR;
+    if (executeMode)
+        strcpy(ident, identVal);
+    getNextToken();	// eat ident
+    if (curToken != TOKEN_LBRACKET) return ERROR_UNEXPECTED_TOKEN;
+    getNextToken();
+    if (curToken != TOKEN_RBRACKET) return ERROR_EXPR_MISSING_BRACKET;
+    getNextToken();
+    if (curToken != TOKEN_RBRACKET) return ERROR_EXPR_MISSING_BRACKET;
+    getNextToken();
+    if (executeMode) {
+        int count;
+        int ret = splitStrArray(ident, &count);
+        if (ret) return ret;
+        if (!stackPushNum((float)count))
+            return ERROR_OUT_OF_MEMORY;
+    }
+    return TYPE_NUMBER;
+}
+
+int parse_EOF() {
+    getNextToken();
+    BasicFile *file;
+    int val = parseFileChannel(&file);
+    if (val) return val;
+    if(executeMode){
+		if(file->open){
+			float eof=host_fileEof(file) ? 1 : 0;
+			if (executeMode && !stackPushNum(eof)){
+				return ERROR_OUT_OF_MEMORY;
+			}
+			return TYPE_NUMBER;	
+		}
+		else{
+			return ERROR_FILE_NOT_OPEN;
+		}
+	}
+	return TYPE_NUMBER;
+}
+
+int parseUnaryNumExp(){
 	//Serial.println("\tparseUnaryNumExp called"); 
     int op = curToken;
     getNextToken();
@@ -1563,13 +2348,16 @@ int parse_INKEY() {
 
 int parse_READLINE() {
     getNextToken();
+    BasicFile *file;
+    int val = parseFileChannel(&file);
+    if (val) return val;
     if (executeMode) {
-		if(basicFileOpen){
-			basicFile=SPIFFS.open(basicFilename,"r");
-			basicFile.seek(basicFileReadPosition,SeekSet);
-			String line=basicFile.readStringUntil('\r');
-			basicFileReadPosition=basicFile.position();
-			basicFile.close();
+		if(file->open){
+			String line;
+			int c;
+			while((c=host_fileReadByte(file))>=0 && c!='\r'){
+				line+=(char)c;
+			}
 			if (!stackPushStr((char*)line.c_str()))
 				return ERROR_OUT_OF_MEMORY;
 		}
@@ -1603,6 +2391,8 @@ int parsePrimary() {
 			return parse_WRITEPOS();
 		case TOKEN_INKEY:
 			return parse_INKEY();
+		case TOKEN_SPLIT:
+			return parse_SPLIT();
 		case TOKEN_MILLIS:	
 			return parse_MILLIS();
 		case TOKEN_FREEMEM:	
@@ -1640,6 +2430,17 @@ int parsePrimary() {
 		case TOKEN_COUNTOF:
 		case TOKEN_CHR:
 		case TOKEN_READ:
+		case TOKEN_KVGET:
+		case TOKEN_FIELD:
+		case TOKEN_SIN:
+		case TOKEN_COS:
+		case TOKEN_ATN:
+		case TOKEN_SQR:
+		case TOKEN_EXP:
+		case TOKEN_LN:
+		case TOKEN_ABS:
+		case TOKEN_SGN:
+		case TOKEN_POW:
 			return parseFnCallExpr();
 
 
@@ -1827,10 +2628,14 @@ int parse_GOTO() {
 int parse_RSEEK() {
 	//Serial.println("\tparse_GOTO called"); 
     getNextToken();
-    int val = expectNumber();
+    BasicFile *file;
+    int val = parseFileChannelArg(&file);
+    if (val) return val;
+    val = expectNumber();
     if (val) return val;	// error
     if (executeMode) {
-		basicFileReadPosition=(int)stackPopNum();
+		host_fileFlush(file);
+		file->readPosition=(int)stackPopNum();
     }
     return 0;
 }
@@ -1838,10 +2643,14 @@ int parse_RSEEK() {
 int parse_WSEEK() {
 	//Serial.println("\tparse_GOTO called"); 
     getNextToken();
-    int val = expectNumber();
+    BasicFile *file;
+    int val = parseFileChannelArg(&file);
+    if (val) return val;
+    val = expectNumber();
     if (val) return val;	// error
     if (executeMode) {
-		basicFileWritePosition=(int)stackPopNum();
+		host_fileFlush(file);
+		file->writePosition=(int)stackPopNum();
     }
     return 0;
 }
@@ -1921,23 +2730,272 @@ int parse_PRINT() {
     return 0;
 }
 
+// GET #n,record,a$ reads a record of a file that was opened with a record length into a string variable
+int parse_GET() {
+    getNextToken();
+    BasicFile *file;
+    int val = parseFileChannelArg(&file);
+    if (val) return val;
+    val = expectNumber();
+    if (val) return val;
+    int record = 0;
+    if (executeMode)
+        record = (int)stackPopNum();
+    if (curToken != TOKEN_COMMA) return ERROR_UNEXPECTED_TOKEN;
+    getNextToken();
+    char ident[MAX_IDENT_LEN+1];
+    if (curToken != TOKEN_IDENT) return ERROR_UNEXPECTED_TOKEN;
+    if (!isStrIdent) return ERROR_EXPR_EXPECTED_STR;
+    if (executeMode)
+        strcpy(ident, identVal);
+    int isArray = 0;
+    getNextToken();	// eat ident
+    if (curToken == TOKEN_LBRACKET) {
+        val = parseSubscriptExpr();
+        if (val) return val;
+        isArray = 1;
+    }
+    if (executeMode) {
+        if (!file->open) return ERROR_FILE_NOT_OPEN;
+        if (file->recordLength==0 || record<0) return ERROR_BAD_PARAMETER;
+        char line[BASIC_FILE_MAX_RECORD+1];
+        host_fileGetRecord(file,record,line);
+        if (!stackPushStr(line)) return ERROR_OUT_OF_MEMORY;
+        if (isArray) {
+            val = setStrArrayElem(ident);
+            if (val) return val;
+        }
+        else {
+            if (!storeStrVariable(ident, stackGetStr())) return ERROR_OUT_OF_MEMORY;
+            stackPopStr();
+        }
+    }
+    return 0;
+}
+
+// PUT #n,record,a$ writes a string as a record of a file that was opened with a record length
+int parse_PUT() {
+    getNextToken();
+    BasicFile *file;
+    int val = parseFileChannelArg(&file);
+    if (val) return val;
+    val = expectNumber();
+    if (val) return val;
+    int record = 0;
+    if (executeMode)
+        record = (int)stackPopNum();
+    if (curToken != TOKEN_COMMA) return ERROR_UNEXPECTED_TOKEN;
+    getNextToken();
+    val = parseExpression();
+    if (val & ERROR_MASK) return val;
+    if (!IS_TYPE_STR(val)) return ERROR_EXPR_EXPECTED_STR;
+    if (executeMode) {
+        String text = String(stackPopStr());
+        if (!file->open) return ERROR_FILE_NOT_OPEN;
+        if (file->recordLength==0 || record<0) return ERROR_BAD_PARAMETER;
+        host_filePutRecord(file,record,text.c_str());
+    }
+    return 0;
+}
+
+// KVPUT k$,v$ stores v$ under the key k$
+int parse_KVPUT() {
+    getNextToken();
+    int val = parseExpression();
+    if (val & ERROR_MASK) return val;
+    if (!IS_TYPE_STR(val)) return ERROR_EXPR_EXPECTED_STR;
+    if (curToken != TOKEN_COMMA) return ERROR_UNEXPECTED_TOKEN;
+    getNextToken();
+    val = parseExpression();
+    if (val & ERROR_MASK) return val;
+    if (!IS_TYPE_STR(val)) return ERROR_EXPR_EXPECTED_STR;
+    if (executeMode) {
+        String value = String(stackPopStr());
+        String key = String(stackPopStr());
+        if (key.length()<1 || key.length()>KV_MAX_KEY || value.length()>KV_MAX_VALUE)
+            return ERROR_BAD_PARAMETER;
+        if (!host_kvPut(key.c_str(),value.c_str()))
+            return ERROR_OUT_OF_MEMORY;
+    }
+    return 0;
+}
+
+// KVDEL k$ removes the key k$
+int parse_KVDEL() {
+    getNextToken();
+    int val = parseExpression();
+    if (val & ERROR_MASK) return val;
+    if (!IS_TYPE_STR(val)) return ERROR_EXPR_EXPECTED_STR;
+    if (executeMode) {
+        String key = String(stackPopStr());
+        if (key.length()>KV_MAX_KEY)
+            return ERROR_BAD_PARAMETER;
+        host_kvDelete(key.c_str());
+    }
+    return 0;
+}
+
+// An array file holds ARRAY_FILE_MAGIC, the type of the array and then the array as it is in the variable table
+// from the number of dimensions on: the number of dimensions, each dimension and the elements.
+#define ARRAY_FILE_MAGIC "BA"
+#define ARRAY_FILE_HEADER 3
+
+// Returns ERROR_FILE_WRITE when the file can not be written completely, a part of a file is removed again.
+int host_arraySave(String filename, char *name, int isString){
+	unsigned char type=isString ? VAR_TYPE_STR_ARRAY : VAR_TYPE_NUM_ARRAY;
+	unsigned char *p=findVariable(name,type);
+	if(p==NULL){
+		return ERROR_VARIABLE_NOT_FOUND;
+	}
+	int skip=3+strlen(name)+1;
+	int length=readLengthFromBuffer(p)-skip;
+	BasicFsFile f=host_fsOpen(filename,"w");
+	if(!host_fsIsOpen(&f)){
+		return ERROR_FILE_WRITE;
+	}
+	bool written=host_fsWrite(&f,(const uint8_t*)ARRAY_FILE_MAGIC,2)==2 &&
+		host_fsWrite(&f,&type,1)==1 &&
+		host_fsWrite(&f,p+skip,length)==length;
+	host_fsClose(&f);
+	if(!written){
+		host_fsRemove(filename);
+		return ERROR_FILE_WRITE;
+	}
+	return ERROR_NONE;
+}
+
+// Replaces the array, like DIM does, by the one in the file. The file is read into the free memory below the
+// variable table and checked there first, so a bad or cut-off file leaves the old array as it was.
+int host_arrayLoad(String filename, char *name, int isString){
+	unsigned char type=isString ? VAR_TYPE_STR_ARRAY : VAR_TYPE_NUM_ARRAY;
+	BasicFsFile f=host_fsOpen(filename,"r");
+	if(!host_fsIsOpen(&f)){
+		return ERROR_FILE_NOT_FOUND;
+	}
+	unsigned char header[ARRAY_FILE_HEADER];
+	int length=host_fsSize(&f)-ARRAY_FILE_HEADER;
+	if(host_fsRead(&f,header,ARRAY_FILE_HEADER)!=ARRAY_FILE_HEADER || memcmp(header,ARRAY_FILE_MAGIC,2)!=0 || header[2]!=type || length<2){
+		host_fsClose(&f);
+		return ERROR_BAD_PARAMETER;
+	}
+	int nameLen=strlen(name);
+	int bytesNeeded=3+nameLen+1+length;
+	if(bytesNeeded>65535){
+		host_fsClose(&f);
+		return ERROR_STRUCTURE_TO_BIG;
+	}
+	if(sysVARSTART-bytesNeeded<sysSTACKEND){
+		host_fsClose(&f);
+		return ERROR_OUT_OF_MEMORY;
+	}
+	unsigned char *newVar=&mem[sysVARSTART-bytesNeeded];
+	unsigned char *p=newVar+3+nameLen+1;
+	int bytesRead=host_fsRead(&f,p,length);
+	host_fsClose(&f);
+	if(bytesRead!=length){
+		return ERROR_BAD_PARAMETER;
+	}
+	// The variable is only replaced when the dimensions match the elements
+	unsigned char *end=p+length;
+	int numDims=readLengthFromBuffer(p);
+	p+=2;
+	if(numDims<1 || numDims>MAX_ARRAY_DIMS || end-p<2*numDims){
+		return ERROR_BAD_PARAMETER;
+	}
+	int numElements=1;
+	for(int i=0;i<numDims;i++){
+		numElements*=readLengthFromBuffer(p);
+		p+=2;
+	}
+	if(isString){
+		int strings=0;
+		for(unsigned char *q=p;q<end;q++){
+			if(*q==0){
+				strings++;
+			}
+		}
+		if(strings!=numElements || (end>p && *(end-1)!=0)){
+			return ERROR_BAD_PARAMETER;
+		}
+	}
+	else if(end-p!=numElements*(int)sizeof(float)){
+		return ERROR_BAD_PARAMETER;
+	}
+	writeLengthToBuffer(bytesNeeded,newVar);
+	newVar[2]=type;
+	strcpy((char*)newVar+3,name);
+	// Deleting the old array moves the variable table up, the new one is then moved along to stay right below it
+	unsigned char *old=findVariable(name,type);
+	if(old!=NULL){
+		deleteVariableAt(old);
+		memmove(&mem[sysVARSTART-bytesNeeded],newVar,bytesNeeded);
+	}
+	sysVARSTART-=bytesNeeded;
+	return ERROR_NONE;
+}
+
+// BSAVE "x",a() writes the array a() to a file in one piece, numbers keep all their bits
+// BLOAD "x",a() creates a() again from that file
+int parseArrayFileCmd() {
+    int op = curToken;
+    getNextToken();
+    int val = parseExpression();
+    if (val & ERROR_MASK) return val;
+    if (!IS_TYPE_STR(val)) return ERROR_EXPR_EXPECTED_STR;
+    if (curToken != TOKEN_COMMA) return ERROR_UNEXPECTED_TOKEN;
+    getNextToken();
+    char ident[MAX_IDENT_LEN+1];
+    if (curToken != TOKEN_IDENT) return ERROR_UNEXPECTED_TOKEN;
+    if (executeMode)
+        strcpy(ident, identVal);
+    int isStringIdentifier = isStrIdent;
+    getNextToken();	// eat ident
+    if (curToken != TOKEN_LBRACKET) return ERROR_UNEXPECTED_TOKEN;
+    getNextToken();
+    if (curToken != TOKEN_RBRACKET) return ERROR_EXPR_MISSING_BRACKET;
+    getNextToken();
+    if (executeMode) {
+        if (strlen(stackGetStr()) > MAX_IDENT_LEN)
+            return ERROR_BAD_PARAMETER;
+        String filename = "/"+String(stackPopStr())+".bdat";
+        if (op == TOKEN_BSAVE)
+            return host_arraySave(filename, ident, isStringIdentifier);
+        return host_arrayLoad(filename, ident, isStringIdentifier);
+    }
+    return 0;
+}
+
+int parse_CLOSE() {
+    getNextToken();
+    BasicFile *file;
+    int val = parseFileChannel(&file);
+    if (val) return val;
+    if (executeMode) {
+		host_fileClose(file);
+    }
+    return 0;
+}
+
 int parse_WRITE() {
     getNextToken();
+    BasicFile *file;
+    int val = parseFileChannelArg(&file);
+    if (val) return val;
     // zero + expressions seperated by semicolons
     int newLine = 1;
     while (curToken != TOKEN_EOL && curToken != TOKEN_CMD_SEP) {
         int val = parseExpression();
         if (val & ERROR_MASK) return val;
         if (executeMode) {
-			if(!basicFileOpen){
+			if(!file->open){
 				return ERROR_FILE_NOT_OPEN;
 			}
-			basicFile=SPIFFS.open(basicFilename,"r+");
-			basicFile.seek(basicFileWritePosition,SeekSet);
+			String text;
             if (IS_TYPE_NUM(val))
-                basicFile.print(String(stackPopNum()));
+                text=String(stackPopNum());
             else
-                basicFile.print(String(stackPopStr()));
+                text=String(stackPopStr());
+			host_fileWrite(file,text.c_str(),text.length());
             newLine = 1;
         }
         if (curToken == TOKEN_SEMICOLON) {
@@ -1946,15 +3004,11 @@ int parse_WRITE() {
         }
     }
     if (executeMode && newLine){
-		if(!basicFileOpen){
+		if(!file->open){
 			return ERROR_FILE_NOT_OPEN;
 		}
-        basicFile.write('\r');
+        host_fileWrite(file,"\r",1);
     }
-    if(executeMode){
-		basicFileWritePosition=basicFile.position();
-		basicFile.close();
-	}
     return 0;
 }
 
@@ -2000,6 +3054,40 @@ int parseTwoIntCmd() {
     return 0;
 }
 
+void host_copyRect(int x, int y, int w, int h, int toX, int toY);
+void host_scrollRect(int x, int y, int w, int h, int dy);
+
+// parse a stmt that takes a rectangle of the screen and more int parameters
+// e.g. COPYRECT 0,0,10,5,20,10 or SCROLL 0,1,80,59,-1
+int parseRectCmd() {
+    int op = curToken;
+    int params = (op == TOKEN_COPYRECT) ? 6 : 5;
+    getNextToken();
+    for (int i = 0; i < params; i++) {
+        if (i > 0) {
+            if (curToken != TOKEN_COMMA)
+                return ERROR_UNEXPECTED_TOKEN;
+            getNextToken();
+        }
+        int val = expectNumber();
+        if (val) return val;	// error
+    }
+    if (executeMode) {
+        int p[6];
+        for (int i = params - 1; i >= 0; i--)
+            p[i] = (int)stackPopNum();
+        switch(op) {
+        case TOKEN_COPYRECT:
+            host_copyRect(p[0],p[1],p[2],p[3],p[4],p[5]);
+            break;
+        case TOKEN_SCROLL:
+            host_scrollRect(p[0],p[1],p[2],p[3],p[4]);
+            break;
+        }
+    }
+    return 0;
+}
+
 // this handles both LET a$="hello" and INPUT a$ type assignments
 int parseAssignment(bool inputStmt) {
 	//Serial.println("\tparseAssignment called"); 
@@ -2233,6 +3321,11 @@ int parse_COLOR(){
 int parse_OPEN_ERASE_SSID(){
     int op = curToken;
     getNextToken();
+    BasicFile *file;
+    if(op==TOKEN_OPEN){
+        int val = parseFileChannelArg(&file);
+        if (val) return val;
+    }
     if(curToken==TOKEN_EOL){
 		return ERROR_EXPR_EXPECTED_STR;
 	}
@@ -2245,25 +3338,30 @@ int parse_OPEN_ERASE_SSID(){
             return ERROR_EXPR_EXPECTED_STR;
         }
     }
+    int recordLength=0;
+    if(op==TOKEN_OPEN && curToken==TOKEN_COMMA){
+        getNextToken();
+        int val = expectNumber();
+        if (val) return val;
+        if(executeMode){
+            recordLength=(int)stackPopNum();
+            if(recordLength<1 || recordLength>BASIC_FILE_MAX_RECORD){
+                stackPopStr();
+                return ERROR_BAD_PARAMETER;
+            }
+        }
+    }
     if(executeMode){
 		char paramStr[MAX_IDENT_LEN+1];
 		if (strlen(stackGetStr()) > MAX_IDENT_LEN)
 			return ERROR_BAD_PARAMETER;
 		strcpy(paramStr, stackPopStr());
 		if(op==TOKEN_OPEN){
-			String filename="/"+String(paramStr)+".bdat";
-			basicFilename=filename;
-			if(!SPIFFS.exists(basicFilename)){
-				basicFile=SPIFFS.open(basicFilename,"w");
-				basicFile.close();
-			}
-			basicFileReadPosition=0;
-			basicFileWritePosition=basicFile.size();
-			basicFileOpen=true;
+			host_fileOpen(file,"/"+String(paramStr)+".bdat",recordLength);
 		}
 		else if(op==TOKEN_ERASE){
 			String filename="/"+String(paramStr)+".bdat";
-			SPIFFS.remove(filename);
+			host_fsRemove(filename);
 		}
 		else if(op==TOKEN_SETSSID){
 			writeStringToSettingFile("SSID",String(paramStr));
@@ -2323,57 +3421,46 @@ int parseLoadSaveCmd() {
 
 void host_clearscreen(bool force);
 
-#ifdef ESP8266
-void host_directory(String ext){
-	Dir dir=SPIFFS.openDir("");
-	while(dir.next()){
-		if(dir.fileName().endsWith(ext)){
-			host_outputString("load \"");
-			host_outputString((char*)dir.fileName().substring(1,dir.fileName().length()-ext.length()).c_str());
-			host_outputChar('"');
-			host_outputChar(0);
-			host_outputInt(dir.fileSize());
-			host_newLine();
-		}
-	}
-}
-#endif
-#ifdef ESP32
 void host_directory(String ext){
-	File dir=SPIFFS.open("/");
-	File file=dir.openNextFile();
-	while(file){
-		if(String(file.name()).endsWith(ext)){
+	BasicDir dir;
+	String filename;
+	int size;
+	host_fsOpenDir(&dir);
+	while(host_fsNextFile(&dir,&filename,&size)){
+		if(filename.endsWith(ext)){
 			host_outputString("load \"");
-			host_outputString((char*)String(file.name()).substring(1,String(file.name()).length()-ext.length()).c_str());
+			host_outputString((char*)filename.substring(1,filename.length()-ext.length()).c_str());
 			host_outputChar('"');
 			host_outputChar(0);
-			host_outputInt(file.size());
+			host_outputInt(size);
 			host_newLine();
 		}
-		file=dir.openNextFile();
 	}
 }
-#endif
 
 void host_welcome(bool force);
+int host_flip();
 
 void showHelp(int page){
-	File helpFile;
+	BasicFsFile helpFile;
 	host_clearscreen(false);
 	if(page==1){
-		helpFile=SPIFFS.open("/help.dat","r");
+		helpFile=host_fsOpen("/help.dat","r");
 	}
 	else if(page==2){
-		helpFile=SPIFFS.open("/help2.dat","r");
+		helpFile=host_fsOpen("/help2.dat","r");
+	}
+	else if(page==4){
+		helpFile=host_fsOpen("/help4.dat","r");
 	}
 	else{
-		helpFile=SPIFFS.open("/help3.dat","r");
+		helpFile=host_fsOpen("/help3.dat","r");
 	}
-	while(helpFile.available()){
-		host_outputChar(helpFile.read());
+	int c;
+	while(host_fsIsOpen(&helpFile) && (c=host_fsReadByte(&helpFile))>=0){
+		host_outputChar(c);
 	}
-	helpFile.close();
+	host_fsClose(&helpFile);
 }
 
 int parseSimpleCmd() {
@@ -2384,8 +3471,7 @@ int parseSimpleCmd() {
         switch (op) {
             case TOKEN_NEW:
                 reset();
-                basicFileReadPosition=0;
-                basicFileOpen=false;
+                host_fileCloseAll();
                 host_welcome(true);
                 breakCurrentLine = 1;
                 break;
@@ -2419,14 +3505,10 @@ int parseSimpleCmd() {
             case TOKEN_DATADIR:
                 host_directory(".bdat");
                 break;
-            case TOKEN_CLOSE:
-				basicFileOpen=false;
-				basicFileReadPosition=0;
-				basicFileWritePosition=0;
-				break;
             case TOKEN_REBOOT:
-				basicFile.close();
+				host_fileCloseAll();
 				host_outputString("Please wait while rebooting");
+				host_flushScreen();
 				delay(50);
 				ESP.restart();
 				break;
@@ -2439,6 +3521,11 @@ int parseSimpleCmd() {
 			case TOKEN_HELPTHREE:
 				showHelp(3);
 				break;
+			case TOKEN_HELPFOUR:
+				showHelp(4);
+				break;
+			case TOKEN_FLIP:
+				return host_flip();
         }
     }
     return 0;
@@ -2502,6 +3589,11 @@ int parseStmts()
 			case TOKEN_POSITION:
 				ret = parseTwoIntCmd(); 
 				break;
+
+			case TOKEN_COPYRECT:
+			case TOKEN_SCROLL:
+				ret = parseRectCmd();
+				break;
 				
 			case TOKEN_SETMEMSIZE:
 				ret = parse_SETMEMSIZE();
@@ -2525,6 +3617,31 @@ int parseStmts()
 				ret=parse_WRITE();
 				break;
 
+			case TOKEN_CLOSE:
+				ret=parse_CLOSE();
+				break;
+
+			case TOKEN_GET:
+				ret=parse_GET();
+				break;
+
+			case TOKEN_PUT:
+				ret=parse_PUT();
+				break;
+
+			case TOKEN_KVPUT:
+				ret=parse_KVPUT();
+				break;
+
+			case TOKEN_KVDEL:
+				ret=parse_KVDEL();
+				break;
+
+			case TOKEN_BSAVE:
+			case TOKEN_BLOAD:
+				ret=parseArrayFileCmd();
+				break;
+
 			case TOKEN_NEW:
 			case TOKEN_STOP:
 			case TOKEN_CONT:
@@ -2532,11 +3649,12 @@ int parseStmts()
 			case TOKEN_RETURN:
 			case TOKEN_DIR:
 			case TOKEN_DATADIR:
-			case TOKEN_CLOSE:
 			case TOKEN_REBOOT:
 			case TOKEN_HELP:
 			case TOKEN_HELPTWO:
 			case TOKEN_HELPTHREE:
+			case TOKEN_HELPFOUR:
+			case TOKEN_FLIP:
 				ret = parseSimpleCmd();
 				break;
 							
@@ -2567,6 +3685,11 @@ int parseStmts()
     return ret;
 }
 
+void host_flushScreenIfDue();
+void host_consoleFlushIfDue();
+void host_videoRecordLine(int line);
+void host_consoleFlush();
+
 int processInput(unsigned char *tokenBuf) {
 	//Serial.println("\tprocessInput called"); 
     // first token can be TOKEN_INTEGER for line number - stored as a float in numVal
@@ -2661,6 +3784,7 @@ int processInput(unsigned char *tokenBuf) {
                 }
 
                 lineNumber = readLengthFromBuffer(p+2);
+                host_videoRecordLine(lineNumber);
                 tokenBuffer = p+4;
                 // if the target for a jump is missing (e.g. line deleted) and we're on the next line
                 // reset the stmt number to 0
@@ -2671,28 +3795,18 @@ int processInput(unsigned char *tokenBuf) {
                 targetStmtNumber = jumpStmtNumber;
             }
            	server.handleClient(); // Check for and handle http-requests
+           	host_flushScreenIfDue();
+           	host_consoleFlushIfDue();
 
-#ifdef ESP8266
-            if(Serial.available()){
-				inkeyChar=Serial.read();
-#endif
-#ifdef ESP32
-            if(Serial2.available()){
-				inkeyChar=Serial2.read();
-#endif
-			}
-			if(httpKeyAvailable){
-				inkeyChar=httpKey;
-				httpKeyAvailable=false;
-			}
-			if(inkeyChar==27){
+			host_readKeyboard();
+			if(host_escPressed()){
                 ret = ERROR_BREAK_PRESSED; 
                 programRunning=false;
-                inkeyChar=0;
                 break;
 			}
         }
     }
+    host_fileFlushAll();
     return ret;
 }
 
@@ -2714,64 +3828,770 @@ void reset() {
 void host_init(int buzzerPin) {
 }
 
-void host_serialOutToVideocard(int x, int y, char c, char color){
+// Protocol to the videocard, see collectData.v and serialLink.v. Only command bytes are 0xF0 or higher.
+// Every packet ends with a check byte, added by host_videoPacket.
+#define VIDEO_CMD_CELL 255 // x, y, character, color
+#define VIDEO_CMD_FILL 254 // x, y, width, height, character, color
+#define VIDEO_CMD_SCROLL 253 // no data, moves the rows of the videocard up by one
+#define VIDEO_CMD_RUN 252 // x, y, color, count, count characters
+#define VIDEO_CMD_TEXT 251 // color, count, count characters written at the cursor, 10 is a new line. NOPs are not counted
+#define VIDEO_CMD_PAGES 250 // bit 0 is the page that is written, bit 1 the page that is shown
+#define VIDEO_CMD_CURSOR 249 // x, y of the cursor for VIDEO_CMD_TEXT
+#define VIDEO_CMD_BAUD 248 // clocks per bit of the uarts of the videocard, which run at 50 MHz
+#define VIDEO_CMD_BLINK 246 // x, y, on. The videocard shows a blinking cursor at x,y of the screen when on is 1
+#define VIDEO_CMD_COPY 245 // x, y, width, height, to x, to y. Copies a rectangle of cells within the page that is written
+#define VIDEO_CMD_PALETTE 244 // 16 colors, shown for the foreground colors 0..7 and the background colors 0..7 of the cells
+#define VIDEO_CMD_NOP 240 // no data, ignored by the videocard
+#define VIDEO_STATUS_BAUD 248 // Sent by the videocard when it changes the baudrate
+#define VIDEO_STATUS_ERROR 247 // Sent by the videocard when a packet was broken
+#define VIDEO_RUN_MAX_GAP 4 // Unchanged cells that are cheaper to resend within a run than to start a new packet
+#define VIDEO_BOOT_BAUDRATE 1843200 // The videocard starts at 50 MHz / 27
+#define VIDEO_FAST_BAUDRATE 5000000 // 50 MHz / 10, also exact for the uarts of the ESP8266 and ESP32 (80 MHz / 16)
+#define VIDEO_FAST_CLKS_PER_BIT 10
+#define VIDEO_FILL_CELLS_PER_SECOND 31500000 // The videocard fills one cell per clock
+#define VIDEO_COPY_CLOCKS_PER_CELL 5 // A copy only runs while the vga does not read the character ram, 192 of the 841 clocks of a line
+#define VIDEO_COPY_START_CLOCKS 841 // and may have to wait for the end of the line first
+#define VIDEO_FRAME_MS 14 // The videocard changes the page it shows at the end of a frame, 75 frames per second
+#define VIDEO_TEXT_SIZE 128
+#define VIDEO_TEXT_QUEUE_LIMIT 64 // Output is streamed as text while less bytes than this wait to be sent, 0 turns streaming off
+
+// All bytes to the videocard go through host_videoWrite. On the ESP32 they are queued in the transmit buffer
+// of the uart driver, which is emptied by interrupt, so output only waits when that buffer is full.
+// The ESP8266 core has no transmit buffer, there a write waits for the 128 byte fifo of the uart.
+// With VIDEO_SPI the bytes are sent over SPI instead, keys and the status of the videocard still come in over the serial line.
 #ifdef ESP8266
-	Serial.write(255);
-	Serial.write(x);
-	Serial.write(y);
-	Serial.write(c);
-	Serial.write(color);
+#define VIDEO_SERIAL Serial
+#define VIDEO_TX_BUFFER_SIZE 128
 #endif
 #ifdef ESP32
-	Serial2.write(255);
-	Serial2.write(x);
-	Serial2.write(y);
-	Serial2.write(c);
-	Serial2.write(color);
+#define VIDEO_SERIAL Serial2
+#define VIDEO_TX_BUFFER_SIZE 8192
+#endif
+#ifdef VIDEO_SPI
+#define VIDEO_BITS_PER_BYTE 8
+#else
+#define VIDEO_BITS_PER_BYTE 10 // Start bit, 8 data bits and stop bit
+#endif
+
+// Statistics of the output to the videocard, shown on /videostats
+unsigned long videoTxBytes=0;
+unsigned long videoTxStalls=0; // Writes that had to wait for room in the transmit buffer
+unsigned long videoTxStallMicros=0;
+int videoTxMaxQueued=0;
+unsigned long videoLinkErrors=0; // Broken packets reported by the videocard
+
+// /videorecord?on=1 records all bytes to the videocard in VIDEO_RECORD_FILE until /videorecord?on=0.
+// fpga-code/decode_video.pl decodes the recording. Before each line of a running program the recording holds
+// VIDEO_RECORD_LINE, the low and the high byte of the line number, these are not sent to the videocard.
+#define VIDEO_RECORD_FILE "/video.rec"
+#define VIDEO_RECORD_LINE 241
+BasicFsFile videoRecordFile;
+bool videoRecording=false;
+
+unsigned long videoBaudrate=VIDEO_BOOT_BAUDRATE; // Or the SPI clock with VIDEO_SPI
+int videoFillCellsPerByte; // Cells the videocard fills during one byte on the serial line, with a margin of 1/16
+
+// Text that is streamed to the text engine of the videocard, see host_videoText
+uint8_t videoText[VIDEO_TEXT_SIZE];
+int videoTextLength=0; // Bytes in videoText, including NOPs
+int videoTextCount=0; // Characters in videoText
+char videoTextColor;
+int videoTextX=-1; // Cursor of the text engine, -1 when it is unknown
+int videoTextY=0;
+bool videoTextScrolled=false; // The text engine scrolls at the new line that was streamed last
+bool videoTextPaused=false;
+
+// The videocard shows the colors of its cells through a palette. Entries 0..7 are shown for the foreground colors
+// and 8..15 for the background colors. videoScreenColor holds the colors of the cells, which may differ from the
+// colors they show, see host_shownColor.
+char videoPalette[16]={0,1,2,3,4,5,6,7,0,1,2,3,4,5,6,7};
+
+int videoCursorX=-1; // Blinking cursor of the videocard, -1 when it is unknown
+int videoCursorY=0;
+bool videoCursorOn=false;
+
+// Bytes that still have to be sent, 0..VIDEO_TX_BUFFER_SIZE also when the driver reports more room than its buffer
+int host_videoQueued(){
+#ifdef VIDEO_SPI
+	return 0; // An SPI write returns when all bytes have been sent
+#else
+	int queued=VIDEO_TX_BUFFER_SIZE-VIDEO_SERIAL.availableForWrite();
+	if(queued<0){
+		return 0;
+	}
+	if(queued>VIDEO_TX_BUFFER_SIZE){
+		return VIDEO_TX_BUFFER_SIZE;
+	}
+	return queued;
 #endif
 }
 
-void host_repaintScreen(){
-	for(int y=0;y<basicY;y++){
-		for(int x=0;x<basicX;x++){
-			if(basicScreenColor[x+y*basicX]!=fgColor|(bgColor<<3)){
-				basicScreenColor[x+y*basicX]=fgColor|(bgColor<<3);
-				host_serialOutToVideocard(x,y,basicScreen[x+y*basicX],basicScreenColor[x+y*basicX]);
-			}
-		}
+#ifdef VIDEO_SPI
+// Every write is one transfer, the videocard starts a new byte when VIDEO_SPI_CS_PIN goes low.
+// SPI.writeBytes fills the 64 byte fifo of the SPI hardware in bursts.
+void host_videoWrite(const uint8_t *data, int len){
+	digitalWrite(VIDEO_SPI_CS_PIN,LOW);
+	SPI.writeBytes(data,len);
+	digitalWrite(VIDEO_SPI_CS_PIN,HIGH);
+	videoTxBytes+=len;
+	if(videoRecording){
+		host_fsWrite(&videoRecordFile,data,len);
+	}
+}
+#else
+void host_videoWrite(const uint8_t *data, int len){
+	int room=VIDEO_SERIAL.availableForWrite();
+	int queued=host_videoQueued()+len;
+	if(queued>VIDEO_TX_BUFFER_SIZE){
+		queued=VIDEO_TX_BUFFER_SIZE;
+	}
+	if(queued>videoTxMaxQueued){
+		videoTxMaxQueued=queued;
+	}
+	if(len>room){
+		unsigned long start=micros();
+		VIDEO_SERIAL.write(data,len);
+		videoTxStalls++;
+		videoTxStallMicros+=micros()-start;
+	}
+	else{
+		VIDEO_SERIAL.write(data,len);
+	}
+	videoTxBytes+=len;
+	if(videoRecording){
+		host_fsWrite(&videoRecordFile,data,len);
 	}
 }
+#endif
 
-void host_scrollBasicScreen(){
-	hostY--;
-	for(int y=0;y<basicY-1;y++){
-		for(int x=0;x<basicX;x++){
-			if(basicScreen[x+(y+1)*basicX]!=basicScreen[x+y*basicX] || basicScreenColor[x+(y+1)*basicX]!=basicScreenColor[x+y*basicX]){
-				basicScreen[x+y*basicX]=basicScreen[x+(y+1)*basicX];
-				basicScreenColor[x+y*basicX]=basicScreenColor[x+(y+1)*basicX];
-				host_serialOutToVideocard(x,y,basicScreen[x+y*basicX],basicScreenColor[x+y*basicX]);
-			}
-		}
-	}	
-	for(int i=0;i<basicX;i++){
-		if(basicScreen[i+(basicY-1)*basicX]!=0){
-			basicScreen[i+(basicY-1)*basicX]=0;
-			basicScreenColor[i+(basicY-1)*basicX]=fgColor|(bgColor<<3);
-			host_serialOutToVideocard(i,basicY-1,basicScreen[i+(basicY-1)*basicX],basicScreenColor[i+(basicY-1)*basicX]);
+// Adds the check byte after the len bytes of packet and sends it, packet needs room for one more byte.
+// The videocard ignores NOPs, so they are not part of the check.
+void host_sendVideoPacket(uint8_t *packet, int len){
+	uint8_t sum=0;
+	for(int i=0;i<len;i++){
+		if(packet[i]!=VIDEO_CMD_NOP){
+			sum+=packet[i];
 		}
 	}
-	/*Serial.write(253);
-	delay(20);*/
+	packet[len]=sum&127;
+	host_videoWrite(packet,len+1);
 }
 
-void host_outputString(char *str) {
-	while (*str) {
-		//Serial.print(*str);
-		if(outputEnabled){
-			basicOutput.print(*str);
-		}
-		host_outputChar(*str);
-		str++;
+// Sends the streamed text that is waiting
+void host_sendVideoText(){
+	if(videoTextLength==0){
+		return;
+	}
+	uint8_t packet[3+VIDEO_TEXT_SIZE+1]={VIDEO_CMD_TEXT,(uint8_t)videoTextColor,(uint8_t)videoTextCount};
+	memcpy(packet+3,videoText,videoTextLength);
+	host_sendVideoPacket(packet,3+videoTextLength);
+	videoTextLength=0;
+	videoTextCount=0;
+}
+
+// Streamed text goes first, so the videocard gets all packets in the order they were made
+void host_videoPacket(uint8_t *packet, int len){
+	host_sendVideoText();
+	host_sendVideoPacket(packet,len);
+}
+
+void host_setVideoBaudrate(unsigned long baudrate){
+	videoBaudrate=baudrate;
+	videoFillCellsPerByte=VIDEO_FILL_CELLS_PER_SECOND/(baudrate/VIDEO_BITS_PER_BYTE)*15/16;
+}
+
+void host_serialOutToVideocard(int x, int y, char c, char color){
+	uint8_t packet[6]={VIDEO_CMD_CELL,(uint8_t)x,(uint8_t)y,(uint8_t)c,(uint8_t)color};
+	host_videoPacket(packet,5);
+}
+
+// Writes count characters in one color from x,y to the right
+void host_serialRunToVideocard(int x, int y, char color, char *chars, int count){
+	uint8_t packet[6+basicX]={VIDEO_CMD_RUN,(uint8_t)x,(uint8_t)y,(uint8_t)color,(uint8_t)count};
+	memcpy(packet+5,chars,count);
+	host_videoPacket(packet,5+count);
+}
+
+// The videocard ignores bytes while it fills, so it is given time by sending NOPs after the fill
+void host_serialFillVideocard(int x, int y, int w, int h, char c, char color){
+	uint8_t packet[8]={VIDEO_CMD_FILL,(uint8_t)x,(uint8_t)y,(uint8_t)w,(uint8_t)h,(uint8_t)c,(uint8_t)color};
+	host_videoPacket(packet,7);
+	uint8_t nops[16];
+	memset(nops,VIDEO_CMD_NOP,sizeof(nops));
+	for(int left=w*h/videoFillCellsPerByte+1;left>0;left-=sizeof(nops)){
+		host_videoWrite(nops,left<(int)sizeof(nops)?left:sizeof(nops));
+	}
+}
+
+// Like a fill the copy is given time with NOPs
+void host_serialCopyVideocard(int x, int y, int w, int h, int toX, int toY){
+	uint8_t packet[8]={VIDEO_CMD_COPY,(uint8_t)x,(uint8_t)y,(uint8_t)w,(uint8_t)h,(uint8_t)toX,(uint8_t)toY};
+	host_videoPacket(packet,7);
+	uint8_t nops[16];
+	memset(nops,VIDEO_CMD_NOP,sizeof(nops));
+	for(int left=(w*h*VIDEO_COPY_CLOCKS_PER_CELL+VIDEO_COPY_START_CLOCKS)/videoFillCellsPerByte+1;left>0;left-=sizeof(nops)){
+		host_videoWrite(nops,left<(int)sizeof(nops)?left:sizeof(nops));
+	}
+}
+
+void host_serialScrollVideocard(){
+	uint8_t packet[2]={VIDEO_CMD_SCROLL};
+	host_videoPacket(packet,1);
+}
+
+// Shows or hides the blinking cursor of the videocard, only changes are sent
+void host_showCursor(int x, int y, bool on){
+	if(videoCursorX==x && videoCursorY==y && videoCursorOn==on){
+		return;
+	}
+	videoCursorX=x;
+	videoCursorY=y;
+	videoCursorOn=on;
+	uint8_t packet[5]={VIDEO_CMD_BLINK,(uint8_t)x,(uint8_t)y,(uint8_t)on};
+	host_videoPacket(packet,4);
+}
+
+void host_serialPaletteToVideocard(){
+	uint8_t packet[18]={VIDEO_CMD_PALETTE};
+	memcpy(packet+1,videoPalette,16);
+	host_videoPacket(packet,17);
+}
+
+void host_serialPagesToVideocard(){
+	uint8_t packet[3]={VIDEO_CMD_PAGES,(uint8_t)(videoWritePage|(videoDisplayPage<<1))};
+	host_videoPacket(packet,2);
+}
+
+// Asks the videocard to switch to VIDEO_FAST_BAUDRATE. It answers at the old baudrate and switches after the answer.
+// Without an answer the link stays at VIDEO_BOOT_BAUDRATE.
+void host_negotiateBaudrate(){
+	host_setVideoBaudrate(VIDEO_BOOT_BAUDRATE);
+	uint8_t packet[3]={VIDEO_CMD_BAUD,VIDEO_FAST_CLKS_PER_BIT};
+	host_videoPacket(packet,2);
+	VIDEO_SERIAL.flush();
+	unsigned long start=millis();
+	while(millis()-start<50){
+		if(VIDEO_SERIAL.available() && VIDEO_SERIAL.read()==VIDEO_STATUS_BAUD){
+			VIDEO_SERIAL.updateBaudRate(VIDEO_FAST_BAUDRATE);
+			host_setVideoBaudrate(VIDEO_FAST_BAUDRATE);
+			return;
+		}
+		yield();
+	}
+}
+
+// Milliseconds until the bytes that are queued now have been sent
+unsigned long host_videoQueuedMillis(){
+	return (unsigned long)host_videoQueued()*VIDEO_BITS_PER_BYTE/(videoBaudrate/1000)+1;
+}
+
+String host_videoStats(){
+	String stats="bytes="+String(videoTxBytes)+"\n";
+	stats+="queued="+String(host_videoQueued())+"\n";
+	stats+="maxqueued="+String(videoTxMaxQueued)+"\n";
+	stats+="stalls="+String(videoTxStalls)+"\n";
+	stats+="stallms="+String(videoTxStallMicros/1000)+"\n";
+	stats+="linkerrors="+String(videoLinkErrors)+"\n";
+	stats+="baud="+String(videoBaudrate)+"\n";
+	return stats;
+}
+
+void host_videoRecordLine(int line){
+	if(videoRecording){
+		uint8_t marker[3]={VIDEO_RECORD_LINE,(uint8_t)(line&255),(uint8_t)(line>>8)};
+		host_fsWrite(&videoRecordFile,marker,3);
+	}
+}
+
+void handleVideoRecord(){
+	if(server.arg("on")=="1"){
+		if(!videoRecording){
+			videoRecordFile=host_fsOpen(VIDEO_RECORD_FILE,"w");
+			videoRecording=host_fsIsOpen(&videoRecordFile);
+		}
+	}
+	else if(videoRecording){
+		videoRecording=false;
+		host_fsClose(&videoRecordFile);
+	}
+	server.send(200,"text/plain",videoRecording?"recording":"stopped");
+}
+
+// Output changes basicScreen and basicScreenColor and marks the line as dirty.
+// host_flushScreen sends the cells of the dirty lines that differ from videoScreen to the videocard,
+// so a cell that is overwritten a number of times before the flush is sent only once.
+char host_videoChar(char c){
+	if(c>=32 && c<=127){
+		return c;
+	}
+	return 0; // The videocard shows all other characters as a space
+}
+
+// Palette entry from base on that shows color, -1 when there is none. The entry of the color itself goes first.
+int host_paletteEntry(int base, char color){
+	if(videoPalette[base+color]==color){
+		return base+color;
+	}
+	for(int i=base;i<base+8;i++){
+		if(videoPalette[i]==color){
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Color of a cell of the videocard that shows color, -1 when the palette has no entries for it
+int host_videoColor(char color){
+	int fg=host_paletteEntry(0,color&7);
+	int bg=host_paletteEntry(8,(color>>3)&7);
+	if(fg<0 || bg<0){
+		return -1;
+	}
+	return fg|((bg-8)<<3);
+}
+
+// Color that a cell of the videocard shows
+char host_shownColor(char videoColor){
+	return videoPalette[videoColor&7]|(videoPalette[8+((videoColor>>3)&7)]<<3);
+}
+
+// Index in videoScreen of the cell of the videocard that shows basicScreen[i]
+int host_videoIndex(int i){
+	return ((i/basicX+videoRowOffset)%videoRows)*basicX+i%basicX;
+}
+
+// Output like PRINT and LIST is also streamed to the text engine of the videocard, which keeps
+// its own cursor and wraps and scrolls by itself. That costs one byte per character and no diffing at the next flush.
+// When VIDEO_TEXT_QUEUE_LIMIT bytes wait, output is faster than the link. Streaming then stops until the next flush,
+// which only sends what is left on the screen.
+bool host_videoTextWanted(){
+	if(videoWritePage!=videoDisplayPage || videoTextPaused || host_videoColor(fgColor|(bgColor<<3))<0){
+		return false;
+	}
+	if(host_videoQueued()>=VIDEO_TEXT_QUEUE_LIMIT){
+		videoTextPaused=true;
+		return false;
+	}
+	return true;
+}
+
+// Streams c, which is written at hostX,hostY, or a new line when c is 10. Mirrors the text engine in videoScreen.
+void host_videoText(char c){
+	char color=host_videoColor(fgColor|(bgColor<<3));
+	int nops=basicX/videoFillCellsPerByte+1; // For the fill of the bottom row after scrolling
+	if(videoTextX!=hostX || videoTextY!=hostY){
+		uint8_t packet[4]={VIDEO_CMD_CURSOR,(uint8_t)hostX,(uint8_t)hostY};
+		host_videoPacket(packet,3);
+		videoTextX=hostX;
+		videoTextY=hostY;
+	}
+	if(color!=videoTextColor || videoTextLength+1+nops>VIDEO_TEXT_SIZE){
+		host_sendVideoText();
+		videoTextColor=color;
+	}
+	videoText[videoTextLength++]=c;
+	videoTextCount++;
+	if(c!=10){
+		videoScreen[host_videoIndex(videoTextX+videoTextY*basicX)]=c;
+		videoScreenColor[host_videoIndex(videoTextX+videoTextY*basicX)]=color;
+		videoTextX++;
+	}
+	if(c==10 || videoTextX==basicX){
+		videoTextX=0;
+		if(videoTextY==basicY-1){
+			memset(videoText+videoTextLength,VIDEO_CMD_NOP,nops);
+			videoTextLength+=nops;
+			videoTextScrolled=true;
+		}
+		else{
+			videoTextY++;
+		}
+	}
+}
+
+bool host_cellChanged(int i){
+	int v=host_videoIndex(i);
+	return host_videoChar(basicScreen[i])!=videoScreen[v] || basicScreenColor[i]!=host_shownColor(videoScreenColor[v]);
+}
+
+// Sends the changed cells of a line. Changed cells of the same color are combined into runs,
+// which may include a few unchanged cells to avoid starting a new packet.
+void host_flushLine(int y){
+	int x=0;
+	while(x<basicX){
+		if(!host_cellChanged(x+y*basicX)){
+			x++;
+			continue;
+		}
+		char color=basicScreenColor[x+y*basicX];
+		int end=x+1;
+		for(int scan=x+1;scan<basicX && basicScreenColor[scan+y*basicX]==color;scan++){
+			if(host_cellChanged(scan+y*basicX)){
+				end=scan+1;
+			}
+			else if(scan+1-end>VIDEO_RUN_MAX_GAP){
+				break;
+			}
+		}
+		char run[basicX];
+		char videoColor=host_videoColor(color);
+		for(int i=x;i<end;i++){
+			run[i-x]=host_videoChar(basicScreen[i+y*basicX]);
+			videoScreen[host_videoIndex(i+y*basicX)]=run[i-x];
+			videoScreenColor[host_videoIndex(i+y*basicX)]=videoColor;
+		}
+		if(end-x==1){
+			host_serialOutToVideocard(x,y,run[0],videoColor);
+		}
+		else{
+			host_serialRunToVideocard(x,y,videoColor,run,end-x);
+		}
+		x=end;
+	}
+}
+
+// Clearing a dirty line in one color with a fill pays off when most of its cells changed, like after CLS,
+// clearing a line or changing the background color. Afterwards only the characters on it have to be sent.
+bool host_lineWantsFill(int y){
+	char color=basicScreenColor[y*basicX];
+	int changed=0;
+	int characters=0;
+	for(int x=0;x<basicX;x++){
+		int i=x+y*basicX;
+		if(basicScreenColor[i]!=color){
+			return false;
+		}
+		if(host_cellChanged(i)){
+			changed++;
+		}
+		if(host_videoChar(basicScreen[i])!=0){
+			characters++;
+		}
+	}
+	return changed>characters+8; // 8 bytes for the fill
+}
+
+void host_fillVideoLines(int y, int h, char color){
+	char videoColor=host_videoColor(color);
+	host_serialFillVideocard(0,y,basicX,h,0,videoColor);
+	for(int i=y*basicX;i<(y+h)*basicX;i++){
+		videoScreen[host_videoIndex(i)]=0;
+		videoScreenColor[host_videoIndex(i)]=videoColor;
+	}
+}
+
+void host_markScreenDirty();
+
+// Makes sure that the palette has entries for the colors of the dirty lines. An entry that no known cell of both
+// pages uses is changed for a missing color. When there is none left, every color shows itself again and
+// the cells that now show another color are sent.
+void host_preparePalette(){
+	bool used[16];
+	bool usedKnown=false;
+	bool changed=false;
+	for(int i=0;i<basicX*basicY;i++){
+		if(!lineDirty[i/basicX] || host_videoColor(basicScreenColor[i])>=0){
+			continue;
+		}
+		if(!usedKnown){
+			memset(used,0,sizeof(used));
+			for(int page=0;page<2;page++){
+				if(videoPages[page]==NULL){
+					continue;
+				}
+				for(int v=0;v<basicX*videoRows;v++){
+					if(videoPages[page][v]!=(char)255){
+						used[videoPagesColor[page][v]&7]=true;
+						used[8+((videoPagesColor[page][v]>>3)&7)]=true;
+					}
+				}
+			}
+			usedKnown=true;
+		}
+		for(int base=0;base<16;base+=8){
+			char color=(base==0) ? (basicScreenColor[i]&7) : ((basicScreenColor[i]>>3)&7);
+			if(host_paletteEntry(base,color)>=0){
+				continue;
+			}
+			int entry=base;
+			while(entry<base+8 && used[entry]){
+				entry++;
+			}
+			if(entry==base+8){
+				for(int e=0;e<16;e++){
+					videoPalette[e]=e&7;
+				}
+				host_markScreenDirty();
+				host_serialPaletteToVideocard();
+				return;
+			}
+			videoPalette[entry]=color;
+			used[entry]=true;
+			changed=true;
+		}
+	}
+	if(changed){
+		host_serialPaletteToVideocard();
+	}
+}
+
+void host_flushScreen(){
+	host_sendVideoText();
+	videoTextPaused=host_videoQueued()>=VIDEO_TEXT_QUEUE_LIMIT;
+	while((long)(millis()-videoFlipDone)<0){ // The page that is written may still be shown, also when millis() wraps
+		yield();
+	}
+	host_preparePalette();
+	// Dirty lines that are cleared by a fill are combined into rectangles
+	int y=0;
+	while(y<basicY){
+		if(lineDirty[y] && host_lineWantsFill(y)){
+			char color=basicScreenColor[y*basicX];
+			int h=1;
+			while(y+h<basicY && lineDirty[y+h] && basicScreenColor[(y+h)*basicX]==color && host_lineWantsFill(y+h)){
+				h++;
+			}
+			host_fillVideoLines(y,h,color);
+			y+=h;
+		}
+		else{
+			y++;
+		}
+	}
+	for(int y=0;y<basicY;y++){
+		if(lineDirty[y]){
+			lineDirty[y]=0;
+			host_flushLine(y);
+		}
+	}
+	nextScreenFlush=millis()+SCREEN_FLUSH_INTERVAL;
+}
+
+void host_flushScreenIfDue(){
+	if(millis()>=nextScreenFlush){
+		host_flushScreen();
+	}
+}
+
+void host_markScreenDirty(){
+	memset(lineDirty,1,basicY);
+}
+
+// Forget what the videocard shows, the next flush sends every cell
+void host_invalidateScreen(){
+	memset(videoScreen,255,basicX*videoRows);
+	host_markScreenDirty();
+}
+
+// The videocard reported a broken packet. What it shows is unknown, so both pages and the page
+// setting are sent again.
+void host_videoLinkError(){
+	videoLinkErrors++;
+	videoTextX=-1;
+	if(videoCursorX>=0){
+		int x=videoCursorX;
+		videoCursorX=-1;
+		host_showCursor(x,videoCursorY,videoCursorOn);
+	}
+	for(int page=0;page<2;page++){
+		if(videoPages[page]!=NULL){
+			memset(videoPages[page],255,basicX*videoRows);
+		}
+	}
+	host_serialPagesToVideocard();
+	host_serialPaletteToVideocard();
+	host_markScreenDirty();
+}
+
+// Moves the keys from the keyboard of the videocard to keyQueue
+void host_readKeyboard(){
+	while(VIDEO_SERIAL.available()){
+		int c=VIDEO_SERIAL.read();
+		if(c==VIDEO_STATUS_ERROR){
+			host_videoLinkError();
+		}
+		else if(c!=VIDEO_STATUS_BAUD){
+			host_queueKey(c);
+		}
+	}
+}
+
+// All cells get the current colors. The palette is set to show them for every color, so the cells of the
+// videocard do not have to be sent again.
+void host_repaintScreen(){
+	memset(basicScreenColor,fgColor|(bgColor<<3),basicX*basicY);
+	memset(videoPalette,fgColor,8);
+	memset(videoPalette+8,bgColor,8);
+	host_serialPaletteToVideocard();
+	host_markScreenDirty();
+}
+
+void host_scrollBasicScreen(){
+	hostY--;
+	memmove(basicScreen,basicScreen+basicX,basicX*(basicY-1));
+	memmove(basicScreenColor,basicScreenColor+basicX,basicX*(basicY-1));
+	memset(basicScreen+basicX*(basicY-1),0,basicX);
+	memset(basicScreenColor+basicX*(basicY-1),fgColor|(bgColor<<3),basicX);
+	if(videoWritePage!=videoDisplayPage){
+		// Scrolling the videocard would also move the page that is shown, so the page that is written is updated instead
+		host_markScreenDirty();
+		return;
+	}
+	// The videocard scrolls by moving the row it shows at the top, so the dirty lines move along.
+	// The new bottom line shows a row of the character ram that was hidden, only its differences are sent.
+	videoRowOffset=(videoRowOffset+1)%videoRows;
+	memmove(lineDirty,lineDirty+1,basicY-1);
+	lineDirty[basicY-1]=1;
+	if(videoTextScrolled){
+		// The text engine scrolls by itself and clears the new bottom line
+		videoTextScrolled=false;
+		for(int i=(basicY-1)*basicX;i<basicY*basicX;i++){
+			videoScreen[host_videoIndex(i)]=0;
+			videoScreenColor[host_videoIndex(i)]=videoTextColor;
+		}
+	}
+	else{
+		host_serialScrollVideocard();
+	}
+}
+
+// Copies the rows of a rectangle of a screen that is a ring of rows, in the order that reads each cell before it is overwritten
+void host_copyRows(char *screen, int rows, int offset, int x, int y, int w, int h, int toX, int toY){
+	for(int r=0;r<h;r++){
+		int row=(toY>y) ? h-1-r : r;
+		memmove(screen+((toY+row+offset)%rows)*basicX+toX,screen+((y+row+offset)%rows)*basicX+x,w);
+	}
+}
+
+// Copies a rectangle of the screen to toX,toY. The parts that fall off the screen are left out.
+// The videocard copies the cells it holds itself, so the screen is flushed first and afterwards nothing has to be sent.
+void host_copyRect(int x, int y, int w, int h, int toX, int toY){
+	if(x<0){ w+=x; toX-=x; x=0; }
+	if(toX<0){ w+=toX; x-=toX; toX=0; }
+	if(y<0){ h+=y; toY-=y; y=0; }
+	if(toY<0){ h+=toY; y-=toY; toY=0; }
+	if(x+w>basicX){ w=basicX-x; }
+	if(toX+w>basicX){ w=basicX-toX; }
+	if(y+h>basicY){ h=basicY-y; }
+	if(toY+h>basicY){ h=basicY-toY; }
+	if(w<=0 || h<=0){
+		return;
+	}
+	host_flushScreen();
+	host_copyRows(basicScreen,basicY,0,x,y,w,h,toX,toY);
+	host_copyRows(basicScreenColor,basicY,0,x,y,w,h,toX,toY);
+	host_copyRows(videoScreen,videoRows,videoRowOffset,x,y,w,h,toX,toY);
+	host_copyRows(videoScreenColor,videoRows,videoRowOffset,x,y,w,h,toX,toY);
+	host_serialCopyVideocard(x,y,w,h,toX,toY);
+}
+
+// Moves the contents of a rectangle of the screen dy rows down, or up when dy is negative.
+// The rows that come free are cleared in the current colors.
+void host_scrollRect(int x, int y, int w, int h, int dy){
+	if(x<0){ w+=x; x=0; }
+	if(y<0){ h+=y; y=0; }
+	if(x+w>basicX){ w=basicX-x; }
+	if(y+h>basicY){ h=basicY-y; }
+	if(w<=0 || h<=0){
+		return;
+	}
+	if(dy>h){ dy=h; }
+	if(dy<-h){ dy=-h; }
+	int rows=abs(dy);
+	int clearY=y;
+	if(dy>0){
+		host_copyRect(x,y,w,h-rows,x,y+rows);
+	}
+	else{
+		host_copyRect(x,y+rows,w,h-rows,x,y);
+		clearY=y+h-rows;
+	}
+	for(int row=clearY;row<clearY+rows;row++){
+		memset(basicScreen+row*basicX+x,0,w);
+		memset(basicScreenColor+row*basicX+x,fgColor|(bgColor<<3),w);
+		lineDirty[row]=1;
+	}
+}
+
+void host_setVideoPages(int writePage, int displayPage){
+	videoWritePage=writePage;
+	videoDisplayPage=displayPage;
+	videoScreen=videoPages[writePage];
+	videoScreenColor=videoPagesColor[writePage];
+	host_serialPagesToVideocard();
+	videoFlipDone=millis()+host_videoQueuedMillis()+VIDEO_FRAME_MS;
+}
+
+// Shows all output since the previous FLIP at once. From the first FLIP on, output goes to the page
+// that is not shown until the next FLIP or until input is asked.
+int host_flip(){
+	if(videoPages[1]==NULL){
+		videoPages[1]=(char*) malloc (basicX*videoRows);
+		videoPagesColor[1]=(char*) malloc (basicX*videoRows);
+		if(videoPages[1]==NULL || videoPagesColor[1]==NULL){
+			free(videoPages[1]);
+			free(videoPagesColor[1]);
+			videoPages[1]=NULL;
+			videoPagesColor[1]=NULL;
+			return ERROR_OUT_OF_MEMORY;
+		}
+		memset(videoPages[1],255,basicX*videoRows);
+	}
+	host_flushScreen();
+	host_setVideoPages(1-videoWritePage,videoWritePage);
+	host_markScreenDirty(); // The page that is written now shows an older screen
+	return 0;
+}
+
+// Output is shown directly again
+void host_showWritePage(){
+	if(videoWritePage!=videoDisplayPage){
+		host_flushScreen();
+		host_setVideoPages(videoWritePage,videoWritePage);
+	}
+}
+
+void host_consoleFlush(){
+	if(consoleLength==0){
+		return;
+	}
+	basicOutput.write(consoleBuffer,consoleLength);
+	consoleBytes+=consoleLength;
+	consoleWrites++;
+	consoleLength=0;
+}
+
+void host_consoleFlushIfDue(){
+	if(consoleLength>0 && millis()>=consoleFlushDue){
+		host_consoleFlush();
+	}
+}
+
+void host_consoleChar(char c){
+	if(!outputEnabled){
+		return;
+	}
+	if(consoleLength==0){
+		consoleFlushDue=millis()+CONSOLE_FLUSH_INTERVAL;
+	}
+	consoleBuffer[consoleLength++]=c;
+	if(c==10 || consoleLength==CONSOLE_BUFFER_SIZE){
+		host_consoleFlush();
+	}
+}
+
+String host_consoleStats(){
+	String stats="bytes="+String(consoleBytes)+"\n";
+	stats+="writes="+String(consoleWrites)+"\n";
+	stats+="queued="+String(consoleLength)+"\n";
+	return stats;
+}
+
+void host_outputString(char *str) {
+	while (*str) {
+		//Serial.print(*str);
+		host_outputChar(*str);
+		str++;
 	}
 }
 
@@ -2787,9 +4607,6 @@ String host_toString(char *str){
 }
 
 void host_outputProgMemString(const char *p) {
-	if(outputEnabled){
-		basicOutput.print(*p);
-	}
 	while (*p) {
 		char c=*p;
 		host_outputChar(c);
@@ -2799,13 +4616,17 @@ void host_outputProgMemString(const char *p) {
 
 void host_outputChar(char c) {
     //Serial.print(c);
-	if(outputEnabled){
-		basicOutput.print(c);
-	}
+	host_consoleChar(c);
 	basicScreen[hostX+hostY*basicX]=c;
 	basicScreenColor[hostX+hostY*basicX]=fgColor|(bgColor<<3);
-	if(c>=32 && c<=127){
-		host_serialOutToVideocard(hostX,hostY,basicScreen[hostX+hostY*basicX],basicScreenColor[hostX+hostY*basicX]);
+	lineDirty[hostY]=1;
+	if(c==10){
+		if(host_videoTextWanted()){
+			host_videoText(10);
+		}
+	}
+	else if(host_cellChanged(hostX+hostY*basicX) && host_videoTextWanted()){
+		host_videoText(host_videoChar(c));
 	}
 	if(c==10){ // If carriage return
 		hostX=basicX; // Goto EOL
@@ -2824,9 +4645,6 @@ void host_outputChar(char c) {
 
 int host_outputInt(long num) {
 	//Serial.print(num);
-	if(outputEnabled){
-		basicOutput.print(num);
-	}
     // returns len
     long i = num, xx = 1;
     int c = 0;
@@ -2864,9 +4682,6 @@ char *host_floatToStr(float f, char *buf) {
 
 void host_outputFloat(float f) {
 	//Serial.print(f);
-	if(outputEnabled){
-		basicOutput.print(f);
-	}
 	if(ceil(f)==f){
 		host_outputString((char *)String((long)ceil(f)).c_str());
 	}
@@ -2877,14 +4692,17 @@ void host_outputFloat(float f) {
 
 void host_newLine() {
 	//Serial.println();
-	if(outputEnabled){
-		basicOutput.println();
+	host_consoleChar(13);
+	host_consoleChar(10);
+	if(host_videoTextWanted()){
+		host_videoText(10);
 	}
 	hostX=0;
 	hostY++;
 	if(hostY==basicY){
 		host_scrollBasicScreen();
 	}
+	host_flushScreenIfDue();
 }
 
 void host_outputFreeMem(unsigned int val){
@@ -2896,74 +4714,74 @@ void host_outputFreeMem(unsigned int val){
 
 void host_removeProgram(String filename){
 	filename="/"+filename+".bas";
-	SPIFFS.remove(filename);
+	host_fsRemove(filename);
 }
 	
 void host_saveProgram(String filename) {
 	filename="/"+filename+".bas";
 	//Serial.println("\tsaveProgram called"); 
-	SPIFFS.remove(filename);
-	File nf=SPIFFS.open(filename,"w");
+	host_fsRemove(filename);
+	BasicFsFile nf=host_fsOpen(filename,"w");
     unsigned char *p = &mem[0];
     while (p < &mem[sysPROGEND]) {
         uint16_t lineNum = readLengthFromBuffer(p+2);
-		nf.print((long)lineNum);
-		nf.print(' ');
+		String line = String((long)lineNum) + ' ';
 		unsigned char * ppt=p+4;
 		int modeREM = 0;
 		while (*ppt != TOKEN_EOL) {
 			if (*ppt == TOKEN_IDENT) {
 				ppt++;
 				while (*ppt < 0x80)
-					nf.write((char)*ppt++);
-				nf.write((char)(*ppt++)-0x80);
+					line += (char)*ppt++;
+				line += (char)(*ppt++ - 0x80);
 			}
 			else if (*ppt == TOKEN_NUMBER) {
 				ppt++;
-				nf.print(readFloatFromBuffer(ppt));
+				line += String(readFloatFromBuffer(ppt));
 				ppt+=4;
 			}
 			else if (*ppt == TOKEN_INTEGER) {
 				ppt++;
-				nf.print(readLongFromBuffer(ppt));
+				line += String(readLongFromBuffer(ppt));
 				ppt+=4;
 			}
 			else if (*ppt == TOKEN_STRING) {
 				ppt++;
 				if (modeREM) {
 					while(*ppt!=0x00){
-						nf.print((char)*ppt++);
+						line += (char)*ppt++;
 					}
 					ppt++;
 				}
 				else {
-					nf.print('\"');
+					line += '\"';
 					while (*ppt) {
 						if (*ppt == '\"'){
-							nf.print('\"');
+							line += '\"';
 						}
-						nf.print((char)*ppt++);
+						line += (char)*ppt++;
 					}
-					nf.print('\"');
+					line += '\"';
 					ppt++;
 				}
 			}
 			else {
 				uint8_t fmt = tokenTable[*ppt].format;
 				if (fmt & TKN_FMT_PRE)
-					nf.print(' ');
-				nf.print((char *)tokenTable[*ppt].token);
+					line += ' ';
+				line += (char *)tokenTable[*ppt].token;
 				if (fmt & TKN_FMT_POST)
-					nf.print(' ');
+					line += ' ';
 				if (*ppt==TOKEN_REM)
 					modeREM = 1;
 				ppt++;
 			}
 		}
-		nf.println();
+		line += "\r\n";
+		host_fsPrint(&nf, line);
 		p+=readLengthFromBuffer(p);
     }
-	nf.close();
+	host_fsClose(&nf);
 }
 
 int host_addLineToProgram(String line){
@@ -2976,6 +4794,7 @@ int host_addLineToProgram(String line){
 	if(ret!=ERROR_NONE){
 		//Serial.println(line);
 		//Serial.println(errorTable[ret]);
+		host_consoleFlush();
 		basicOutput.println(line);
 		basicOutput.println(errorTable[ret]);
 		return ret;
@@ -2992,6 +4811,7 @@ int host_addLineToProgram(String line){
 		if (ret != ERROR_NONE) {
 			//Serial.println(line);
 			//Serial.println(errorTable[ret]);
+			host_consoleFlush();
 			basicOutput.println(line);
 			basicOutput.println(errorTable[ret]);
 			return ret;
@@ -3005,13 +4825,16 @@ int host_loadProgram(String filename) {
 	// TBD: Optimize reading by reading until eol. Just make sure that during writing script.bas always only CR (\10) is used as eol.
 	// 		Currently loading the script takes 5 to 10 times longer than running the script.
 	reset();
-    File f=SPIFFS.open(filename,"r");
+    BasicFsFile f=host_fsOpen(filename,"r");
     String line;
-    while(f.available()){
-		char c=f.read();
+    int next=host_fsIsOpen(&f) ? host_fsReadByte(&f) : -1;
+    while(next>=0){
+		char c=next;
+		next=host_fsReadByte(&f);
 		if(c==13 || c==10){
-			if(f.available()){
-				c=f.read(); // In case of newline also read possible carriage return
+			if(next>=0){
+				c=next; // In case of newline also read possible carriage return
+				next=host_fsReadByte(&f);
 			}
 			else{
 				c=10;
@@ -3032,24 +4855,374 @@ int host_loadProgram(String filename) {
 			line=line+c;
 		}
 	}
-    f.close();
+    host_fsClose(&f);
     return 0;
 }
 
-void host_clearscreen(bool force){
-	for(int y=0;y<basicY;y++){
-		for(int x=0;x<basicX;x++){
-			if(force){
-				basicScreenColor[x+y*basicX]=fgColor|(bgColor<<3);
+void host_fileFlush(BasicFile *f){
+	if(f->writeLength>0){
+		host_fsSeek(&f->file,f->writeStart);
+		host_fsWrite(&f->file,f->writeBuffer,f->writeLength);
+		f->writeLength=0;
+	}
+}
+
+void host_fileFlushAll(){
+	for(int i=0;i<BASIC_FILE_CHANNELS;i++){
+		host_fileFlush(&basicFiles[i]);
+	}
+}
+
+void host_fileClose(BasicFile *f){
+	if(f->open){
+		host_fileFlush(f);
+		host_fsClose(&f->file);
+	}
+	f->open=false;
+	f->readPosition=0;
+	f->writePosition=0;
+}
+
+void host_fileCloseAll(){
+	for(int i=0;i<BASIC_FILE_CHANNELS;i++){
+		host_fileClose(&basicFiles[i]);
+	}
+}
+
+void host_fileOpen(BasicFile *f, String filename, int recordLength){
+	host_fileClose(f);
+	f->recordLength=recordLength;
+	f->file=host_fsOpenReadWrite(filename);
+	f->size=host_fsSize(&f->file);
+	f->readPosition=0;
+	f->writePosition=f->size;
+	f->readLength=0;
+	f->writeLength=0;
+	f->open=true;
+}
+
+// Returns the byte at the read position and moves it on, or -1 at the end of the file
+int host_fileReadByte(BasicFile *f){
+	if(f->readPosition<f->readStart || f->readPosition>=f->readStart+f->readLength){
+		host_fileFlush(f);
+		host_fsSeek(&f->file,f->readPosition);
+		f->readStart=f->readPosition;
+		f->readLength=host_fsRead(&f->file,f->readBuffer,BASIC_FILE_BUFFER_SIZE);
+		if(f->readLength<=0){
+			f->readLength=0;
+			return -1;
+		}
+	}
+	return f->readBuffer[f->readPosition++-f->readStart];
+}
+
+bool host_fileEof(BasicFile *f){
+	return f->readPosition>=f->size;
+}
+
+// Writes len bytes at the write position and moves it on
+void host_fileWrite(BasicFile *f, const char *data, int len){
+	if(f->writeLength>0 && f->writeStart+f->writeLength!=f->writePosition){
+		host_fileFlush(f);
+	}
+	// Bytes that are read later have to come from the file again
+	if(f->writePosition<f->readStart+f->readLength && f->writePosition+len>f->readStart){
+		f->readLength=0;
+	}
+	for(int i=0;i<len;i++){
+		if(f->writeLength==BASIC_FILE_BUFFER_SIZE){
+			host_fileFlush(f);
+		}
+		if(f->writeLength==0){
+			f->writeStart=f->writePosition;
+		}
+		f->writeBuffer[f->writeLength++]=data[i];
+		f->writePosition++;
+	}
+	if(f->writePosition>f->size){
+		f->size=f->writePosition;
+	}
+}
+
+// Reads record number record into line, without the spaces at its end
+void host_fileGetRecord(BasicFile *f, int record, char *line){
+	f->readPosition=record*f->recordLength;
+	int length=0;
+	int c;
+	while(length<f->recordLength && (c=host_fileReadByte(f))>=0){
+		line[length++]=c;
+	}
+	while(length>0 && line[length-1]==' '){
+		length--;
+	}
+	line[length]=0;
+}
+
+// Writes text as record number record, cut off or filled up with spaces to the record length.
+// Records between the end of the file and this one are filled with spaces.
+void host_filePutRecord(BasicFile *f, int record, const char *text){
+	char spaces[16];
+	memset(spaces,' ',sizeof(spaces));
+	int position=record*f->recordLength;
+	if(position>f->size){
+		f->writePosition=f->size;
+		while(f->writePosition<position){
+			int len=position-f->writePosition;
+			host_fileWrite(f,spaces,len<(int)sizeof(spaces)?len:sizeof(spaces));
+		}
+	}
+	f->writePosition=position;
+	int len=strlen(text);
+	if(len>f->recordLength){
+		len=f->recordLength;
+	}
+	host_fileWrite(f,text,len);
+	while(len<f->recordLength){
+		int fill=f->recordLength-len;
+		if(fill>(int)sizeof(spaces)){
+			fill=sizeof(spaces);
+		}
+		host_fileWrite(f,spaces,fill);
+		len+=fill;
+	}
+}
+
+uint16_t host_kvHash(const char *key){
+	uint32_t hash=2166136261UL;
+	while(*key){
+		hash=(hash^(uint8_t)*key++)*16777619UL;
+	}
+	return (hash>>16)^(hash&0xFFFF);
+}
+
+// Reads the record at offset into kvRecord, unless it is there already
+void host_kvRead(uint32_t offset){
+	if(offset!=kvRecordOffset){
+		host_fsSeek(&kvFile,offset);
+		int length=host_fsRead(&kvFile,kvRecord,sizeof(kvRecord));
+		if(length<0){
+			length=0;
+		}
+		memset(kvRecord+length,0,sizeof(kvRecord)-length);
+		kvRecordOffset=offset;
+	}
+}
+
+// Returns the slot of key in kvIndex or -1. *freeSlot is set to the slot where key can be added.
+int host_kvFind(const char *key, uint16_t hash, int *freeSlot){
+	*freeSlot=-1;
+	int keyLength=strlen(key);
+	int slot=hash%KV_INDEX_SIZE;
+	for(int i=0;i<KV_INDEX_SIZE;i++){
+		KvSlot *s=&kvIndex[slot];
+		if(s->offset==KV_EMPTY){
+			if(*freeSlot<0){
+				*freeSlot=slot;
 			}
-			if(force || basicScreen[x+y*basicX]!=0){
-				basicScreen[x+y*basicX]=0;
-				host_serialOutToVideocard(x,y,0,basicScreenColor[x+y*basicX]);
+			return -1;
+		}
+		if(s->offset==KV_REMOVED){
+			if(*freeSlot<0){
+				*freeSlot=slot;
+			}
+		}
+		else if(s->hash==hash){
+			host_kvRead(s->offset);
+			if(kvRecord[0]==keyLength && memcmp(kvRecord+2,key,keyLength)==0){
+				return slot;
 			}
 		}
+		slot=(slot+1)%KV_INDEX_SIZE;
+	}
+	return -1;
+}
+
+// Points kvIndex to the record of key at offset, or removes key when the record is for KVDEL
+void host_kvIndex(const char *key, uint32_t offset, int length, bool deleted){
+	uint16_t hash=host_kvHash(key);
+	int freeSlot;
+	int slot=host_kvFind(key,hash,&freeSlot);
+	if(slot>=0){
+		kvOldBytes+=kvIndex[slot].length;
+		if(deleted){
+			kvIndex[slot].offset=KV_REMOVED;
+			kvKeys--;
+		}
+		else{
+			kvIndex[slot].offset=offset;
+			kvIndex[slot].length=length;
+		}
+	}
+	else if(!deleted && freeSlot>=0){
+		if(kvIndex[freeSlot].offset==KV_EMPTY){
+			kvUsedSlots++;
+		}
+		kvIndex[freeSlot].offset=offset;
+		kvIndex[freeSlot].hash=hash;
+		kvIndex[freeSlot].length=length;
+		kvKeys++;
+	}
+	if(deleted){
+		kvOldBytes+=length;
+	}
+}
+
+bool host_kvCompact();
+
+// Opens KV_FILE and builds kvIndex from its records. The file is compacted when it ends in a record that was cut off,
+// so that the bytes of that record are not read as a record after the next one is added.
+void host_kvLoad(){
+	if(kvLoaded){
+		return;
+	}
+	for(int i=0;i<KV_INDEX_SIZE;i++){
+		kvIndex[i].offset=KV_EMPTY;
+	}
+	kvKeys=0;
+	kvUsedSlots=0;
+	kvOldBytes=0;
+	kvRecordOffset=KV_EMPTY;
+	kvInOldFile=false;
+	if(!host_fsExists(KV_FILE) && host_fsExists(KV_OLD_FILE)){
+		// Compacting was interrupted before the new file took the place of KV_FILE
+		kvInOldFile=!host_fsRename(KV_OLD_FILE,KV_FILE);
+	}
+	kvFile=host_fsOpenReadWrite(kvInOldFile ? KV_OLD_FILE : KV_FILE);
+	kvSize=host_fsSize(&kvFile);
+	uint32_t offset=0;
+	bool cutOff=false;
+	while(offset<kvSize){
+		host_kvRead(offset);
+		int keyLength=kvRecord[0]&~KV_DELETED;
+		int length=2+keyLength+kvRecord[1];
+		if(keyLength>KV_MAX_KEY || offset+length>kvSize){
+			kvSize=offset;
+			cutOff=true;
+			break;
+		}
+		char key[KV_MAX_KEY+1];
+		memcpy(key,kvRecord+2,keyLength);
+		key[keyLength]=0;
+		host_kvIndex(key,offset,length,kvRecord[0]&KV_DELETED);
+		offset+=length;
+	}
+	kvLoaded=true;
+	if(cutOff){
+		host_kvCompact();
+	}
+}
+
+// Copies the records of the keys to a new KV_FILE. Returns false when that failed, the store is then unchanged.
+bool host_kvCompact(){
+	if(kvInOldFile){
+		return false;
+	}
+	BasicFsFile newFile=host_fsOpen(KV_TEMP_FILE,"w");
+	if(!host_fsIsOpen(&newFile)){
+		return false;
+	}
+	bool written=true;
+	for(int i=0;i<KV_INDEX_SIZE && written;i++){
+		if(kvIndex[i].offset<KV_REMOVED){
+			host_kvRead(kvIndex[i].offset);
+			written=host_fsWrite(&newFile,kvRecord,kvIndex[i].length)==kvIndex[i].length;
+		}
+	}
+	host_fsClose(&newFile);
+	if(!written){
+		host_fsRemove(KV_TEMP_FILE);
+		return false;
+	}
+	host_fsClose(&kvFile);
+	host_fsRemove(KV_OLD_FILE);
+	bool replaced=false;
+	if(host_fsRename(KV_FILE,KV_OLD_FILE)){
+		replaced=host_fsRename(KV_TEMP_FILE,KV_FILE);
+		if(!replaced){
+			host_fsRename(KV_OLD_FILE,KV_FILE);
+		}
+	}
+	if(!replaced){
+		// kvIndex still matches the old file, which is KV_OLD_FILE when it could not be renamed back
+		host_fsRemove(KV_TEMP_FILE);
+		kvInOldFile=!host_fsExists(KV_FILE);
+		kvFile=host_fsOpenReadWrite(kvInOldFile ? KV_OLD_FILE : KV_FILE);
+		kvRecordOffset=KV_EMPTY;
+		return false;
+	}
+	host_fsRemove(KV_OLD_FILE);
+	kvLoaded=false;
+	host_kvLoad();
+	return true;
+}
+
+// Adds the record for KVPUT, or for KVDEL when value is NULL, at the end of KV_FILE
+void host_kvAppend(const char *key, const char *value){
+	int keyLength=strlen(key);
+	int valueLength=value ? strlen(value) : 0;
+	kvRecord[0]=keyLength|(value ? 0 : KV_DELETED);
+	kvRecord[1]=valueLength;
+	memcpy(kvRecord+2,key,keyLength);
+	if(value){
+		memcpy(kvRecord+2+keyLength,value,valueLength);
+	}
+	int length=2+keyLength+valueLength;
+	uint32_t offset=kvSize;
+	host_fsSeek(&kvFile,offset);
+	host_fsWrite(&kvFile,kvRecord,length);
+	host_fsFlush(&kvFile);
+	kvRecordOffset=offset;
+	kvSize+=length;
+	host_kvIndex(key,offset,length,value==NULL);
+	if(kvOldBytes>=KV_COMPACT_BYTES && kvOldBytes>kvSize/2){
+		host_kvCompact();
+	}
+}
+
+// Returns false when there is no room for another key
+bool host_kvPut(const char *key, const char *value){
+	host_kvLoad();
+	int freeSlot;
+	if(host_kvFind(key,host_kvHash(key),&freeSlot)<0 && kvUsedSlots>=KV_MAX_KEYS){
+		// Slots of removed keys are only freed by compacting
+		if(!host_kvCompact() || kvKeys>=KV_MAX_KEYS){
+			return false;
+		}
+	}
+	host_kvAppend(key,value);
+	return true;
+}
+
+// Copies the value of key to value, which is empty when there is no such key
+void host_kvGet(const char *key, char *value){
+	host_kvLoad();
+	int freeSlot;
+	int slot=host_kvFind(key,host_kvHash(key),&freeSlot);
+	value[0]=0;
+	if(slot>=0){
+		host_kvRead(kvIndex[slot].offset);
+		memcpy(value,kvRecord+2+kvRecord[0],kvRecord[1]);
+		value[kvRecord[1]]=0;
+	}
+}
+
+void host_kvDelete(const char *key){
+	host_kvLoad();
+	int freeSlot;
+	if(host_kvFind(key,host_kvHash(key),&freeSlot)>=0){
+		host_kvAppend(key,NULL);
+	}
+}
+
+void host_clearscreen(bool force){
+	memset(basicScreen,0,basicX*basicY);
+	if(force){
+		memset(basicScreenColor,fgColor|(bgColor<<3),basicX*basicY);
+		host_invalidateScreen();
+	}
+	else{
+		host_markScreenDirty();
 	}
-	/*Serial.write(254);
-	delay(10);*/
 	hostX=0;
 	hostY=0;
 }
@@ -3061,6 +5234,8 @@ void host_runProgram(String trigger){
 	tokenBuf[1] = 0;
 	host_clearscreen(true);
 	processInput(tokenBuf);
+	host_showWritePage();
+	host_flushScreen();
 	//Serial.println("\nEnd of basic program");
 }
 
@@ -3074,6 +5249,8 @@ int host_getFreeHostMem(){
 
 char *host_readLine() {
     inputMode = 1;
+	host_showWritePage();
+	host_consoleFlush();
 
     if (hostX == 0){
 //		for(int x=0;x<basicX;x++){
@@ -3086,46 +5263,22 @@ char *host_readLine() {
 	}
     int startPos = hostY*basicX+hostX;
     int pos = startPos;
+    host_flushScreen();
+    host_showCursor(hostX,hostY,true); // The videocard blinks the cursor
 
     bool done = false;
-    bool keyHandled=false;
     char c;
     while (!done) {
-#ifdef ESP8266
-        if (Serial.available()) {
-#endif
-#ifdef ESP32
-        if (Serial2.available()) {
-#endif
-            // read the next key
+        host_readKeyboard();
+        c = host_nextKey();
+		if(c){
             lineDirty[pos / basicX] = 1;
-#ifdef ESP8266
-            c = Serial.read();
-#endif
-#ifdef ESP32
-            c = Serial2.read();
-#endif
-			keyHandled=true;
-		}
-		if(httpKeyAvailable && !keyHandled){
-			c = httpKey;
-			httpKeyAvailable=false;
-			keyHandled=true;
-		}
-		if(keyHandled){
-			keyHandled=false;
-            if(!flashCursor && ((c>=32 && c<=126) || c==8 || c==13 || (c>=17 && c<=20) || (c>=1 && c<=4) || c==24)){ // Restore the actual character at the cursorlocation
-				host_serialOutToVideocard(hostX,hostY,basicScreen[hostX+hostY*basicX],basicScreenColor[hostX+hostY*basicX]);
-				flashCursor=true;
-				nextFlashCursorEvent=0;
-			}
             if (c>=32 && c<=126){
                 basicScreen[pos++] = c;
-                host_serialOutToVideocard(hostX,hostY,c,basicScreenColor[hostX+hostY*basicX]);
 			}
             else if (c==8 && pos > startPos){ // BACKSPACE
                 basicScreen[--pos] = 0;
-                host_serialOutToVideocard(hostX-1,hostY,0,basicScreenColor[hostX+hostY*basicX]);
+                lineDirty[pos / basicX] = 1;
 			}
 			else if (c==17){ // Cursor down
 				if(pos+basicX<basicX*basicY){
@@ -3165,12 +5318,8 @@ char *host_readLine() {
             }
             else if (c==24){ // DELETE = clear line
 				int y=(pos/basicX);
-				for(int x=0;x<basicX;x++){
-					if(basicScreen[x+basicX*y]>0){
-						basicScreen[x+basicX*y]=0;
-						host_serialOutToVideocard(x,y,0,basicScreenColor[x+basicX*y]);
-					}
-				}
+				memset(basicScreen+basicX*y,0,basicX);
+				lineDirty[y]=1;
 				pos=((int)(pos/basicX))*basicX;
 			}
 			else if (c==1){ // PageUp = Search empty line up
@@ -3203,31 +5352,20 @@ char *host_readLine() {
                 else
                 {
                     basicScreen[--pos] = 0;
-					host_serialOutToVideocard(hostX-1,hostY,0,basicScreenColor[hostX+hostY*basicX]);
+                    lineDirty[pos / basicX] = 1;
                     hostX = pos % basicX;
                     hostY = pos / basicX;
                 }
             }
+            host_flushScreen();
+            host_showCursor(hostX,hostY,true);
             yield();
         }
-        else{
-			if(millis()>nextFlashCursorEvent){
-				if(flashCursor){
-					host_serialOutToVideocard(hostX,hostY,'_',basicScreenColor[hostX+hostY*basicX]);
-				}
-				else{
-					host_serialOutToVideocard(hostX,hostY,basicScreen[hostX+hostY*basicX],basicScreenColor[hostX+hostY*basicX]);
-				}
-				flashCursor=!flashCursor;
-				nextFlashCursorEvent=millis()+500;
-			}
-		}
 		espLoop();
     }
     basicScreen[pos] = 0;
     inputMode = 0;
-    // remove the cursor
-    lineDirty[hostY] = 1;
+    host_showCursor(hostX,hostY,false);
     return &basicScreen[startPos];
 }
 
@@ -3261,22 +5399,39 @@ void handleBasicRecv(){
 }
 
 void handleHttpKey(){
-	httpKeyAvailable=true;
-	httpKey=(char)server.arg(0)[0];
+	host_queueKey((char)server.arg(0)[0]);
 	server.send(200,"text/plain","OK");
 }
 
+// Adds the characters of the keys argument to keyQueue in order and answers with the number that fitted
+void handleHttpKeys(){
+	String keys=server.arg("keys");
+	int taken=keys.length();
+	if(taken>host_keyQueueFree()){
+		taken=host_keyQueueFree();
+	}
+	for(int i=0;i<taken;i++){
+		host_queueKey(keys[i]);
+	}
+	server.send(200,"text/plain",String(taken));
+}
+
 void basicSetup(){
 #ifdef ESP8266
-	Serial.begin(1843200); // From now on the serial output is used to communicate to the videocard + keyboard-controller
+	Serial.begin(VIDEO_BOOT_BAUDRATE); // From now on the serial output is used to communicate to the videocard + keyboard-controller
 	addConfigParameter(F("basicMemory"),F("Size of basic memory in bytes"),F("16384"),MainConfigPage,true,3);
 #endif
 #ifdef ESP32
-	Serial2.begin(1843200); // The ESP32 is unable to start with connections to serial0, so serial2 is used to communicate with videocard + keyboard-controller
+	Serial2.setTxBufferSize(VIDEO_TX_BUFFER_SIZE); // Has to be set before begin
+	Serial2.begin(VIDEO_BOOT_BAUDRATE); // The ESP32 is unable to start with connections to serial0, so serial2 is used to communicate with videocard + keyboard-controller
 	addConfigParameter(F("basicMemory"),F("Size of basic memory in bytes"),F("113792"),MainConfigPage,true,3); // 113792 bytes is the largest block available on a ESP32
 #endif
 	basicScreen = (char*) malloc (basicX*basicY);
 	basicScreenColor = (char*) malloc (basicX*basicY);
+	videoPages[0] = (char*) malloc (basicX*videoRows);
+	videoPagesColor[0] = (char*) malloc (basicX*videoRows);
+	videoScreen = videoPages[0];
+	videoScreenColor = videoPagesColor[0];
 	bool memAllocationFailed=false;
 	MEMORY_SIZE=readIntFromSettingFile("basicMemory");
 	mem=(unsigned char*) malloc(MEMORY_SIZE);
@@ -3286,10 +5441,27 @@ void basicSetup(){
 		memAllocationFailed=true;
 	}
 	reset();
+	host_fsBegin();
 	server.on("/sourceinfo/basic",[](){server.send(200,"text/plain",libraryTimeBasic);});
 	server.on("/basicrecv",handleBasicRecv);
 	server.on("/httpkey",handleHttpKey);
+	server.on("/httpkeys",handleHttpKeys);
+	server.on("/videostats",[](){server.send(200,"text/plain",host_videoStats());});
+	server.on("/consolestats",[](){server.send(200,"text/plain",host_consoleStats());});
+	server.on("/videorecord",handleVideoRecord);
+	server.on("/keystats",[](){server.send(200,"text/plain",host_keyStats());});
 	digitalWrite(ActivePin,HIGH);
+#ifdef VIDEO_SPI
+	pinMode(VIDEO_SPI_CS_PIN,OUTPUT);
+	digitalWrite(VIDEO_SPI_CS_PIN,HIGH);
+	SPI.begin();
+	SPI.setFrequency(VIDEO_SPI_FREQUENCY);
+	SPI.setDataMode(SPI_MODE0);
+	SPI.setBitOrder(MSBFIRST);
+	host_setVideoBaudrate(VIDEO_SPI_FREQUENCY);
+#else
+	host_negotiateBaudrate();
+#endif
 	host_welcome(true);
 	if(memAllocationFailed){
 		bgColor=COLOR_RED;
@@ -8,6 +8,33 @@
 // v002:	* Moved from magnatic-esp8266 to magnatic-esp
 //			* Fixed a bug where the ip address was incorrent when the deviceAP was used
 
+// v003:	* Added math functions SIN, COS, ATN, SQR, EXP, LN, ABS, SGN and POW
+//			* Output goes to the basicScreen buffers and only changed cells of dirty lines are flushed to the videocard
+//			* Changed cells are sent to the videocard as runs of characters instead of one packet per cell
+//			* Scrolling is done by the videocard, only the new bottom line is sent
+//			* Lines that are mostly cleared are filled by the videocard, as after CLS, SETBG, SETFG and clearing a line
+//			* Output to the videocard is queued in an 8KB interrupt driven transmit buffer on the ESP32, statistics on /videostats
+//			* Added FLIP for double buffered output on two pages of the videocard
+//			* Packets to the videocard end with a check byte, broken packets are reported and the screen is sent again
+//			* The link with the videocard switches to 5 Mbaud when the videocard supports it
+//			* Optional SPI link to the videocard, see VIDEO_SPI
+//			* Output is streamed to a text engine in the videocard that wraps and scrolls by itself while the link keeps up
+//			* The videocard blinks the cursor of the line input by itself
+//			* COPYRECT and SCROLL move a part of the screen, the videocard copies the cells itself
+//			* The videocard shows colors through a palette, SETFG and SETBG only change the palette
+//			* Output to basicOutput is buffered and written per line, statistics on /consolestats
+//			* /videorecord records the bytes to the videocard, fpga-code/decode_video.pl decodes them and shows statistics
+//			* Keys from the keyboard and /httpkey wait in a queue, so fast typing loses no keys, statistics on /keystats
+//			* keyboard.html sends the keys that were typed or pasted in batches to /httpkeys
+//			* A data file stays open from OPEN to CLOSE, reads and writes go through a buffer
+//			* OPEN #n, data files can be open on channels #1 to #8 at the same time
+//			* GET and PUT read and write records by number in files that are opened with a record length
+//			* KVPUT, KVGET$ and KVDEL keep keys and values in the flash, with an index in memory
+//			* All file access goes through the host_fs functions, BASIC_FS_LITTLEFS puts the files on LittleFS instead of SPIFFS,
+//			  BASIC_FS_POSIX in a directory of the host
+//			* BSAVE and BLOAD write and read a whole array as one binary file
+//			* SPLIT puts the fields of a string in a string array, FIELD$ returns one field
+
 #ifndef _BASIC_H
 #define _BASIC_H
 
@@ -19,6 +46,7 @@
 #define TOKEN_NUMBER	        3	// special case - number follows
 #define TOKEN_STRING	        4	// special case - string follows
 
+#define TOKEN_HASH		7
 #define TOKEN_LBRACKET	        8
 #define TOKEN_RBRACKET	        9
 #define TOKEN_PLUS	    	10
@@ -111,11 +139,33 @@
 #define TOKEN_READ				97
 #define TOKEN_WRITEPOS			98
 #define TOKEN_HELPTHREE			99
+#define TOKEN_SIN				100
+#define TOKEN_COS				101
+#define TOKEN_ATN				102
+#define TOKEN_SQR				103
+#define TOKEN_EXP				104
+#define TOKEN_LN				105
+#define TOKEN_ABS				106
+#define TOKEN_SGN				107
+#define TOKEN_POW				108
+#define TOKEN_HELPFOUR			109
+#define TOKEN_FLIP				110
+#define TOKEN_COPYRECT			111
+#define TOKEN_SCROLL			112
+#define TOKEN_GET				113
+#define TOKEN_PUT				114
+#define TOKEN_KVPUT				115
+#define TOKEN_KVGET				116
+#define TOKEN_KVDEL				117
+#define TOKEN_BSAVE				118
+#define TOKEN_BLOAD				119
+#define TOKEN_SPLIT				120
+#define TOKEN_FIELD				121
 
 #define FIRST_IDENT_TOKEN 23
-#define LAST_IDENT_TOKEN 99
+#define LAST_IDENT_TOKEN 121
 
-#define FIRST_NON_ALPHA_TOKEN    8
+#define FIRST_NON_ALPHA_TOKEN    7
 #define LAST_NON_ALPHA_TOKEN    22
 
 #define ERROR_NONE				0
@@ -147,17 +197,31 @@
 #define ERROR_BAD_PARAMETER                     24
 #define ERROR_FILE_NOT_OPEN						25
 #define ERROR_STRUCTURE_TO_BIG					26
+#define ERROR_FILE_NOT_FOUND					27
+#define ERROR_FILE_WRITE					28
 
 #define MAX_IDENT_LEN	10
 #define MAX_NUMBER_LEN	10
+#define MAX_ARRAY_DIMS	8
+
+// Uncomment to send the screen to the videocard over SPI instead of the serial line. The parameter SPI_LINK of spiRX
+// in the videocard has to be set to 1 as well.
+//#define VIDEO_SPI
+#define VIDEO_SPI_FREQUENCY 20000000
+
+// Uncomment to use the float kernels in bcbasic.cpp for SIN, COS, ATN, EXP, LN and POW instead of libm.
+// They are less accurate, examples/mathbench.bas shows whether they are faster on the ESP that is used.
+//#define BASIC_FAST_MATH
 
 #ifdef ESP8266
 //#define MEMORY_SIZE	16384
 #define ActivePin 5
+#define VIDEO_SPI_CS_PIN 4 // GPIO15, the usual chip select, has to be low at boot and the videocard pulls it up
 #endif
 #ifdef ESP32
 //#define MEMORY_SIZE 70000
 #define ActivePin 21
+#define VIDEO_SPI_CS_PIN 5
 #endif
 #define TOKEN_BUF_SIZE    256
 
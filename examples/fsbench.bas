@@ -0,0 +1,13 @@
+10 REM Times OPEN, RSEEK and READ$ on the filesystem that BASIC uses, SPIFFS or LittleFS
+20 ERASE "fsbench": OPEN #2,"fsbench"
+30 FOR I=1 TO 400: WRITE #2,"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvw": NEXT I
+40 CLOSE #2: PRINT "File of ";400*50;" bytes"
+50 T=MILLIS: FOR I=1 TO 100: OPEN #2,"fsbench": CLOSE #2: NEXT I
+60 PRINT "OPEN and CLOSE:    ";(MILLIS-T)*10;" us"
+70 OPEN #2,"fsbench": T=MILLIS
+80 FOR I=1 TO 1000: RSEEK #2,(I*4973) MOD 20000: A$=READ$(#2,10): NEXT I
+90 PRINT "RSEEK and READ$:   ";MILLIS-T;" us"
+100 T=MILLIS: RSEEK #2,0
+110 FOR I=1 TO 400: A$=READLINE$ #2: NEXT I
+120 PRINT "READLINE$:         ";(MILLIS-T)*2.5;" us"
+130 CLOSE #2: ERASE "fsbench"
@@ -0,0 +1,12 @@
+10 REM Times the math functions. Run it on a build with BASIC_FAST_MATH and one without to compare them
+20 N=1000: PRINT "Microseconds per call, ";N;" calls each"
+30 T=MILLIS: FOR I=1 TO N: Y=I*0.01: NEXT I: E=MILLIS-T
+40 PRINT "Loop       ";E*1000/N
+50 T=MILLIS: FOR I=1 TO N: Y=SIN(I*0.01): NEXT I: PRINT "SIN        ";(MILLIS-T-E)*1000/N
+60 T=MILLIS: FOR I=1 TO N: Y=COS(I*0.01): NEXT I: PRINT "COS        ";(MILLIS-T-E)*1000/N
+70 T=MILLIS: FOR I=1 TO N: Y=ATN(I*0.01): NEXT I: PRINT "ATN        ";(MILLIS-T-E)*1000/N
+80 T=MILLIS: FOR I=1 TO N: Y=SQR(I*0.01): NEXT I: PRINT "SQR        ";(MILLIS-T-E)*1000/N
+90 T=MILLIS: FOR I=1 TO N: Y=EXP(I*0.01): NEXT I: PRINT "EXP        ";(MILLIS-T-E)*1000/N
+100 T=MILLIS: FOR I=1 TO N: Y=LN(I*0.01): NEXT I: PRINT "LN         ";(MILLIS-T-E)*1000/N
+110 T=MILLIS: FOR I=1 TO N: Y=POW(I*0.01,2.5): NEXT I: PRINT "POW(x,2.5) ";(MILLIS-T-E)*1000/N
+120 T=MILLIS: FOR I=1 TO N: Y=POW(I*0.01,3): NEXT I: PRINT "POW(x,3)   ";(MILLIS-T-E)*1000/N
@@ -0,0 +1,11 @@
+10 REM readtest.bas scaled up: writes N lines, reads them back with READLINE$ and READ$ and prints lines/s
+20 N=1000: ERASE "readbig": OPEN ("readbig")
+30 T=MILLIS: FOR I=1 TO N: WRITE "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvw": NEXT I
+40 CLOSE: PRINT "WRITE      ";N*1000/(MILLIS-T);" lines/s"
+50 OPEN ("readbig"): C=0: T=MILLIS
+60 A$=READLINE$: C=C+1: IF EOF=0 THEN GOTO 60
+70 PRINT "READLINE$  ";C*1000/(MILLIS-T);" lines/s"
+80 RSEEK (0): T=MILLIS: FOR I=1 TO N: A$=READ$(50): NEXT I
+90 PRINT "READ$(50)  ";N*1000/(MILLIS-T);" lines/s"
+100 IF C<>N THEN PRINT "Read ";C;" of ";N;" lines"
+110 CLOSE: ERASE "readbig"
@@ -0,0 +1,9 @@
+10 REM readwrite.bas scaled up: N times WSEEK and WRITE a line, then RSEEK and READLINE$ it again, prints lines/s
+20 N=1000: ERASE "rwbig": OPEN ("rwbig")
+30 T=MILLIS: FOR I=0 TO N-1: WSEEK (I*10): WRITE "123456789": RSEEK (I*10): A$=READLINE$: NEXT I
+40 PRINT "WRITE and READLINE$  ";N*1000/(MILLIS-T);" lines/s"
+50 IF A$<>"123456789" THEN PRINT "Wrong line: ";A$
+60 T=MILLIS: FOR I=N-1 TO 0 STEP -1: RSEEK (I*10): A$=READLINE$: NEXT I
+70 PRINT "RSEEK and READLINE$  ";N*1000/(MILLIS-T);" lines/s"
+80 IF A$<>"123456789" THEN PRINT "Wrong line: ";A$
+90 CLOSE: ERASE "rwbig"
@@ -16,6 +16,7 @@
 //--
 //-- INPUTS:
 //--     -clk: System clock (12 MHZ in the iceStick board)
+//--     -divisor: Clock cycles per bit, can be changed while clk_ena is 0
 //--     -clk_ena: clock enable:
 //--            1. Normal working: The squeare signal is generated
 //--            0: stoped. Output always 0
@@ -28,34 +29,31 @@
 //--   <-------  Period ------------------------->
 //--
 //---------------------------------------------------------------------------------------
-module baudgen_rx #(
-         parameter BAUDRATE = 27  //-- Default baudrate (10 MHz and 115200)
-)(
+module baudgen_rx(
          input wire clk,          //-- System clock
+         input wire [7:0] divisor,//-- Baudrate divisor (27 for 50 MHz and 1843200)
          input wire clk_ena,      //-- Clock enable
          output wire clk_out      //-- Bitrate Clock output
 );
 
-//-- Number of bits needed for storing the baudrate divisor
-localparam N = $clog2(BAUDRATE);
-
 //-- Value for generating the pulse in the middle of the period
-localparam M2 = (BAUDRATE >> 1);
+wire [7:0] M2 = (divisor >> 1);
 
-//-- Counter for implementing the divisor (it is a BAUDRATE module counter)
-//-- (when BAUDRATE is reached, it start again from 0)
-reg [N-1:0] divcounter = 0;
+//-- Counter for implementing the divisor (it is a divisor module counter)
+//-- (when divisor is reached, it start again from 0)
+reg [7:0] divcounter = 0;
 
 //-- Contador módulo M
 always @(posedge clk)
 
   if (clk_ena)
     //-- Normal working: counting. When the maximum count is reached, it starts from 0
-    divcounter <= (divcounter == BAUDRATE - 1) ? 0 : divcounter + 1;
+    divcounter <= (divcounter == divisor - 8'd1) ? 8'd0 : divcounter + 8'd1;
   else
-    //-- Counter fixed to its maximum value
-    //-- When it is resumed it start from 0
-    divcounter <= BAUDRATE - 1;
+    //-- Counter fixed to 1 while stopped. uart_rx enables it two clock cycles after the start bit
+    //-- reached rx, through rx_r and its state register, so the first pulse comes that much earlier
+    //-- and the bits are sampled in their middle also at small divisors
+    divcounter <= 8'd1;
 
 //-- The output is 1 when the counter is in the middle of the period, if clk_ena is active
 //-- It is 1 only for one system clock cycle
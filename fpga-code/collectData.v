@@ -1,45 +1,483 @@
+// Protocol ESP --> FPGA. Command bytes are 0xF0 and up, all other bytes are below 0xF0.
+// Every packet ends with a check byte, the sum of all bytes of the packet including the command byte, modulo 128.
+//   0xFF, x, y, character, color, check						Write one cell
+//   0xFE, x, y, width, height, character, color, check	Fill a rectangle with one character and color
+//   0xFD, check													Scroll the screen up one row
+//   0xFC, x, y, color, count, count x character, check	Write count cells from x,y to the right in one color
+//   0xFB, color, count, count x character, check			Write text at the cursor, see below
+//   0xFA, pages, check											Bit 0 is the page that is written, bit 1 the page that is shown
+//   0xF9, x, y, check											Set the cursor of the text engine
+//   0xF8, clocks per bit, check								Set the baudrate, handled by serialLink
+//   0xF6, x, y, on, check										Show the blinking cursor at x,y of the screen when on is 1
+//   0xF5, x, y, width, height, to x, to y, check		Copy a rectangle of cells to x,y on the same page
+//   0xF4, 16 x color, check									Set the palette, see below
+//   0xF0															Nothing, used by the ESP to wait for a fill. Ignored everywhere, also within a packet
+// The character ram holds two pages of 80x64 cells. Each page is used as a ring of 64 rows. rowOffset is the row
+// that is shown at the top of the screen, scrolling moves it one row down. Rows written by the ESP are relative to rowOffset.
+// A fill writes one cell per clock. Bytes received while filling are ignored, so the ESP sends
+// enough 0xF0 bytes after a fill to cover the time it takes.
+// A copy reads the character ram through the port of the vga, which only has it free while the beam is outside the
+// visible area. The vga says so with blitWindow, then one cell is copied per clock. That is about a quarter of the
+// clocks, the ESP sends 0xF0 bytes for the time it takes as with a fill. The copy runs in the direction that
+// reads every cell of an overlapping rectangle before it is written.
+// The text engine writes the characters of a text packet at its cursor and moves the cursor to the right. 10 moves the
+// cursor to the start of the next row, 13 to the start of the row. After the last column the cursor wraps to the next row.
+// Moving down from the last of the TEXT_ROWS rows that are shown scrolls the screen and fills the new bottom row with
+// character 0 in the color of the packet, during which bytes are ignored as with a fill.
+// The color of a cell holds a foreground color in bits 2..0 and a background color in bits 5..3. The vga shows them
+// through the palette: the first 8 colors of the palette packet are shown for the foreground colors and the next 8
+// for the background colors. It starts with every color showing itself.
+// A packet with a wrong check byte, a packet that is cut short by a command byte or data outside a packet is a link error.
+// linkError toggles and serialLink reports it to the ESP, which then sends the whole screen again. A broken packet is
+// not carried out, except for runs and text packets. Their characters are written as they arrive, so the cells written
+// before the error was found stay. A text packet has also moved the cursor by then and may have scrolled the screen
+// and filled the new bottom row.
 module collectData(
 		input clock,
 		input [7:0]received,
 		input ready,
 		input computerRunning,
-		output reg [12:0] pos,
+		output reg [13:0] pos,
 		output reg writeEnable,
 		output reg [7:0] character,
-		output reg [7:0] color
+		output reg [7:0] color,
+		output reg [5:0] rowOffset,
+		output reg displayPage,
+		output reg linkError,
+		output reg [13:0] cursor,		// Bit 13 shows the blinking cursor, bits 12..7 are its row and bits 6..0 its column
+		input blitWindow,				// The vga leaves the read port of the character ram to blitAddr during the next clock
+		input [7:0] ramCharacter,	// Cell read from the character ram, valid one clock after blitAddr
+		input [7:0] ramColor,
+		output reg [13:0] blitAddr,
+		output reg [47:0] palette		// 3 bits per color, foreground colors 0..7 in bits 23..0, then background colors 0..7
 	);
-	reg [1:0]state;
+	localparam IDLE			= 6'd0;
+	localparam CELL_X			= 6'd1;
+	localparam CELL_Y			= 6'd2;
+	localparam CELL_CHAR		= 6'd3;
+	localparam CELL_COLOR	= 6'd4;
+	localparam CELL_CHECK	= 6'd5;
+	localparam RUN_X			= 6'd6;
+	localparam RUN_Y			= 6'd7;
+	localparam RUN_COLOR		= 6'd8;
+	localparam RUN_COUNT		= 6'd9;
+	localparam RUN_CHAR		= 6'd10;
+	localparam RUN_CHECK		= 6'd11;
+	localparam FILL_X			= 6'd12;
+	localparam FILL_Y			= 6'd13;
+	localparam FILL_WIDTH	= 6'd14;
+	localparam FILL_HEIGHT	= 6'd15;
+	localparam FILL_CHAR		= 6'd16;
+	localparam FILL_COLOR	= 6'd17;
+	localparam FILL_CHECK	= 6'd18;
+	localparam FILLING		= 6'd19;
+	localparam SCROLL_CHECK	= 6'd20;
+	localparam PAGES			= 6'd21;
+	localparam PAGES_CHECK	= 6'd22;
+	localparam BAUD			= 6'd23;
+	localparam BAUD_CHECK	= 6'd24;
+	localparam CURSOR_X		= 6'd25;
+	localparam CURSOR_Y		= 6'd26;
+	localparam CURSOR_CHECK	= 6'd27;
+	localparam TEXT_COLOR	= 6'd28;
+	localparam TEXT_COUNT	= 6'd29;
+	localparam TEXT_CHAR		= 6'd30;
+	localparam TEXT_CHECK	= 6'd31;
+	localparam BLINK_X		= 6'd32;
+	localparam BLINK_Y		= 6'd33;
+	localparam BLINK_ON		= 6'd34;
+	localparam BLINK_CHECK	= 6'd35;
+	localparam COPY_X			= 6'd36;
+	localparam COPY_Y			= 6'd37;
+	localparam COPY_WIDTH	= 6'd38;
+	localparam COPY_HEIGHT	= 6'd39;
+	localparam COPY_TO_X		= 6'd40;
+	localparam COPY_TO_Y		= 6'd41;
+	localparam COPY_CHECK	= 6'd42;
+	localparam COPYING		= 6'd43;
+	localparam PALETTE		= 6'd44;
+	localparam PALETTE_CHECK= 6'd45;
+
+	localparam TEXT_COLUMNS	= 7'd80;
+	localparam TEXT_ROWS		= 6'd60;
+	localparam PALETTE_SELF	= 24'o76543210;
+
+	reg [5:0]state;
+	reg [5:0]afterFill;	// State to return to after a fill, a text packet continues after scrolling
+	reg [6:0]x;
+	reg [5:0]y;
+	reg [7:0]count;
+	reg [6:0]fillX;
+	reg [6:0]fillWidth;
+	reg [7:0]fillCharacter;
+	reg [6:0]cursorX;
+	reg [5:0]cursorY;
+	reg [6:0]column;
+	reg [5:0]rows;
+	reg writePage;
+	reg [1:0]pages;
+	reg cursorOn;
+	reg [6:0]sum;
+	reg [6:0]toX;
+	reg [5:0]toY;
+	reg [6:0]copyFromX;		// Column where each row of the copy starts
+	reg [6:0]copyToX;
+	reg copyLeft;				// Copy each row from right to left
+	reg copyUp;					// Copy the rows from bottom to top
+	reg copyRead;				// A cell was read in the previous clock and is written now
+	reg [6:0]copyWriteX;
+	reg [5:0]copyWriteY;
+	reg [47:0]newPalette;
+
+	// Address of a cell in the character ram
+	function [13:0] cellAddress(input page, input [5:0] row, input [6:0] column);
+		cellAddress=(page ? 14'd5120 : 14'd0)+{row,6'b000000}+{row,4'b0000}+column;
+	endfunction
+
+	// ready is a pulse from the uart receiver, which runs on another clock.
+	// It is turned into a toggle and synchronised to clock. received stays valid until the next byte.
+	reg readyToggle=1'b0;
+	reg [2:0]readySync=3'b000;
+	always @(posedge ready)
+		readyToggle<=~readyToggle;
+	always @(posedge clock)
+		readySync<={readySync[1:0],readyToggle};
+	wire byteReceived=readySync[2]^readySync[1];
+	wire checkOk=(received[6:0]==sum);
 
 	// Handle incoming serial data
-	always @(posedge ready) begin
-		case (received)
-			8'b11111111: 	begin
-									state<=2'b00;
-									writeEnable<=1'b0;
+	always @(posedge clock) begin
+		writeEnable<=1'b0;
+		if(!computerRunning) begin
+			state<=IDLE;
+			rowOffset<=6'd0;
+			writePage<=1'b0;
+			displayPage<=1'b0;
+			linkError<=1'b0;
+			cursorX<=7'd0;
+			cursorY<=6'd0;
+			cursor<=14'd0;
+			palette<={PALETTE_SELF,PALETTE_SELF};
+		end
+		else if(state==FILLING) begin
+			// Write one cell of the rectangle, left to right and then top to bottom
+			pos<=cellAddress(writePage,y+rowOffset,x);
+			character<=fillCharacter;
+			writeEnable<=1'b1;
+			if(column==fillWidth-7'd1) begin
+				column<=7'd0;
+				x<=fillX;
+				y<=y+6'd1;
+				rows<=rows-6'd1;
+				if(rows==6'd1)
+					state<=afterFill;
+			end
+			else begin
+				column<=column+7'd1;
+				x<=x+7'd1;
+			end
+		end
+		else if(state==COPYING) begin
+			// Write the cell that was read in the previous clock
+			if(copyRead) begin
+				pos<=cellAddress(writePage,copyWriteY+rowOffset,copyWriteX);
+				character<=ramCharacter;
+				color<=ramColor;
+				writeEnable<=1'b1;
+			end
+			copyRead<=1'b0;
+			if(rows==6'd0) begin
+				if(!copyRead)
+					state<=IDLE;
+			end
+			else if(blitWindow) begin
+				// Read the next cell, x,y is the source and toX,toY the destination
+				blitAddr<=cellAddress(writePage,y+rowOffset,x);
+				copyRead<=1'b1;
+				copyWriteX<=toX;
+				copyWriteY<=toY;
+				if(column==fillWidth-7'd1) begin
+					column<=7'd0;
+					x<=copyFromX;
+					toX<=copyToX;
+					y<=copyUp ? y-6'd1 : y+6'd1;
+					toY<=copyUp ? toY-6'd1 : toY+6'd1;
+					rows<=rows-6'd1;
+				end
+				else begin
+					column<=column+7'd1;
+					x<=copyLeft ? x-7'd1 : x+7'd1;
+					toX<=copyLeft ? toX-7'd1 : toX+7'd1;
+				end
+			end
+		end
+		else if(byteReceived && received!=8'hF0) begin
+			if(received>=8'hF0) begin
+				// A command byte always starts a new packet
+				sum<=received[6:0];
+				if(state!=IDLE)
+					linkError<=~linkError;
+				case (received)
+					8'hFF:	state<=CELL_X;
+					8'hFE:	state<=FILL_X;
+					8'hFD:	state<=SCROLL_CHECK;
+					8'hFC:	state<=RUN_X;
+					8'hFB:	state<=TEXT_COLOR;
+					8'hFA:	state<=PAGES;
+					8'hF9:	state<=CURSOR_X;
+					8'hF6:	state<=BLINK_X;
+					8'hF5:	state<=COPY_X;
+					8'hF4:	begin
+									state<=PALETTE;
+									count<=8'd16;
 								end
-			default: case (state)
-							2'b00: 	begin
-											pos[12:6]<=received[6:0];
-											state=2'b01;
-											writeEnable<=1'b0;
+					8'hF8:	state<=BAUD;
+					default:	state<=IDLE;
+				endcase
+			end
+			else begin
+				sum<=sum+received[6:0];
+				case (state)
+					CELL_X:		begin
+										x<=received[6:0];
+										state<=CELL_Y;
+									end
+					CELL_Y:		begin
+										y<=received[5:0];
+										state<=CELL_CHAR;
+									end
+					CELL_CHAR:	begin
+										character<=received;
+										state<=CELL_COLOR;
+									end
+					CELL_COLOR:	begin
+										color<=received;
+										state<=CELL_CHECK;
+									end
+					CELL_CHECK:	begin
+										if(checkOk) begin
+											pos<=cellAddress(writePage,y+rowOffset,x);
+											writeEnable<=1'b1;
 										end
-							2'b01: 	begin
-											pos[5:0]<=received[5:0];
-											state=2'b10;
-											writeEnable<=1'b0;
+										else
+											linkError<=~linkError;
+										state<=IDLE;
+									end
+					RUN_X:		begin
+										x<=received[6:0];
+										state<=RUN_Y;
+									end
+					RUN_Y:		begin
+										y<=received[5:0];
+										state<=RUN_COLOR;
+									end
+					RUN_COLOR:	begin
+										color<=received;
+										state<=RUN_COUNT;
+									end
+					RUN_COUNT:	begin
+										count<=received;
+										state<=(received==8'd0) ? RUN_CHECK : RUN_CHAR;
+									end
+					RUN_CHAR:	begin
+										// Write the character and move to the next cell in the row
+										pos<=cellAddress(writePage,y+rowOffset,x);
+										character<=received;
+										writeEnable<=1'b1;
+										x<=x+7'd1;
+										count<=count-8'd1;
+										if(count==8'd1)
+											state<=RUN_CHECK;
+									end
+					FILL_X:		begin
+										x<=received[6:0];
+										fillX<=received[6:0];
+										state<=FILL_Y;
+									end
+					FILL_Y:		begin
+										y<=received[5:0];
+										state<=FILL_WIDTH;
+									end
+					FILL_WIDTH:	begin
+										fillWidth<=received[6:0];
+										column<=7'd0;
+										state<=FILL_HEIGHT;
+									end
+					FILL_HEIGHT:begin
+										rows<=received[5:0];
+										state<=FILL_CHAR;
+									end
+					FILL_CHAR:	begin
+										fillCharacter<=received;
+										state<=FILL_COLOR;
+									end
+					FILL_COLOR:	begin
+										color<=received;
+										state<=FILL_CHECK;
+									end
+					FILL_CHECK:	begin
+										if(!checkOk) begin
+											linkError<=~linkError;
+											state<=IDLE;
 										end
-							2'b10: 	begin
-											state<=2'b11;
-											character<=received;
-											writeEnable<=1'b0;
+										else
+											state<=(fillWidth==7'd0 || rows==6'd0) ? IDLE : FILLING;
+										afterFill<=IDLE;
+									end
+					CURSOR_X:	begin
+										x<=received[6:0];
+										state<=CURSOR_Y;
+									end
+					CURSOR_Y:	begin
+										y<=received[5:0];
+										state<=CURSOR_CHECK;
+									end
+					COPY_X:		begin
+										x<=received[6:0];
+										state<=COPY_Y;
+									end
+					COPY_Y:		begin
+										y<=received[5:0];
+										state<=COPY_WIDTH;
+									end
+					COPY_WIDTH:	begin
+										fillWidth<=received[6:0];
+										column<=7'd0;
+										state<=COPY_HEIGHT;
+									end
+					COPY_HEIGHT:begin
+										rows<=received[5:0];
+										state<=COPY_TO_X;
+									end
+					COPY_TO_X:	begin
+										toX<=received[6:0];
+										state<=COPY_TO_Y;
+									end
+					COPY_TO_Y:	begin
+										toY<=received[5:0];
+										state<=COPY_CHECK;
+									end
+					COPY_CHECK:	begin
+										if(!checkOk) begin
+											linkError<=~linkError;
+											state<=IDLE;
 										end
-							2'b11:	begin
-											color<=received;
-											writeEnable<=1'b1;
+										else begin
+											// Start at the corner that is read before the destination can overwrite it
+											copyLeft<=(toX>x);
+											copyUp<=(toY>y);
+											copyFromX<=(toX>x) ? x+fillWidth-7'd1 : x;
+											copyToX<=(toX>x) ? toX+fillWidth-7'd1 : toX;
+											if(toX>x) begin
+												x<=x+fillWidth-7'd1;
+												toX<=toX+fillWidth-7'd1;
+											end
+											if(toY>y) begin
+												y<=y+rows-6'd1;
+												toY<=toY+rows-6'd1;
+											end
+											copyRead<=1'b0;
+											state<=(fillWidth==7'd0 || rows==6'd0) ? IDLE : COPYING;
+										end
+									end
+					BLINK_X:		begin
+										x<=received[6:0];
+										state<=BLINK_Y;
+									end
+					BLINK_Y:		begin
+										y<=received[5:0];
+										state<=BLINK_ON;
+									end
+					BLINK_ON:	begin
+										cursorOn<=received[0];
+										state<=BLINK_CHECK;
+									end
+					TEXT_COLOR:	begin
+										color<=received;
+										state<=TEXT_COUNT;
+									end
+					TEXT_COUNT:	begin
+										count<=received;
+										state<=(received==8'd0) ? TEXT_CHECK : TEXT_CHAR;
+									end
+					TEXT_CHAR:	begin
+										count<=count-8'd1;
+										state<=(count==8'd1) ? TEXT_CHECK : TEXT_CHAR;
+										if(received==8'd13)
+											cursorX<=7'd0;
+										else begin
+											if(received!=8'd10) begin
+												pos<=cellAddress(writePage,cursorY+rowOffset,cursorX);
+												character<=received;
+												writeEnable<=1'b1;
+											end
+											if(received==8'd10 || cursorX==TEXT_COLUMNS-7'd1) begin
+												cursorX<=7'd0;
+												if(cursorY==TEXT_ROWS-6'd1) begin
+													// Scroll and clear the new bottom row
+													rowOffset<=rowOffset+6'd1;
+													x<=7'd0;
+													fillX<=7'd0;
+													y<=TEXT_ROWS-6'd1;
+													fillWidth<=TEXT_COLUMNS;
+													fillCharacter<=8'd0;
+													column<=7'd0;
+													rows<=6'd1;
+													afterFill<=(count==8'd1) ? TEXT_CHECK : TEXT_CHAR;
+													state<=FILLING;
+												end
+												else
+													cursorY<=cursorY+6'd1;
+											end
+											else
+												cursorX<=cursorX+7'd1;
+										end
+									end
+					PALETTE:		begin
+										// The first color ends up in the lowest bits
+										newPalette<={received[2:0],newPalette[47:3]};
+										count<=count-8'd1;
+										if(count==8'd1)
+											state<=PALETTE_CHECK;
+									end
+					PAGES:		begin
+										pages<=received[1:0];
+										state<=PAGES_CHECK;
+									end
+					BAUD:			state<=BAUD_CHECK;
+					RUN_CHECK,
+					TEXT_CHECK,
+					SCROLL_CHECK,
+					PAGES_CHECK,
+					CURSOR_CHECK,
+					BLINK_CHECK,
+					PALETTE_CHECK,
+					BAUD_CHECK:	begin
+										if(!checkOk)
+											linkError<=~linkError;
+										else if(state==SCROLL_CHECK)
+											rowOffset<=rowOffset+6'd1;
+										else if(state==PAGES_CHECK) begin
+											writePage<=pages[0];
+											displayPage<=pages[1];
+										end
+										else if(state==CURSOR_CHECK) begin
+											cursorX<=x;
+											cursorY<=y;
 										end
-						endcase
-		endcase
-		if(!computerRunning)
-			state<=2'b00;
+										else if(state==BLINK_CHECK)
+											cursor<={cursorOn,y,x};
+										else if(state==PALETTE_CHECK)
+											palette<=newPalette;
+										state<=IDLE;
+									end
+					default:		begin
+										// Data outside a packet
+										linkError<=~linkError;
+										state<=IDLE;
+									end
+				endcase
+			end
+		end
 	end
 endmodule
@@ -0,0 +1,314 @@
+#!/usr/bin/perl
+# Decodes a recording of the bytes the ESP sends to the videocard, made with /videorecord, like collectData.v does.
+# Prints statistics of the traffic and the screen that is shown at the end.
+# Usage: decode_video.pl video.rec [-ansi] [-frames] [-ppm screen.ppm]
+#   -ansi    Print screens with their colors as ANSI escape codes instead of plain text
+#   -frames  Also print the screen that is shown at every change of the pages, like at FLIP
+#   -ppm     Write the screen that is shown at the end as a 640x480 image, using the font of the videocard
+# The recording holds 0xF1, line number low byte, high byte before the output of each line of a running program.
+# That marker is not sent to the videocard, it is used for the bytes per line.
+$mx=80;
+$my=64;
+$rows=60;
+@names=('NOP','line','','','palette','copy','blink','','baud','cursor','pages','text','run','scroll','fill','cell');
+
+$file=shift @ARGV;
+die "Usage: decode_video.pl video.rec [-ansi] [-frames] [-ppm screen.ppm]\n" unless defined $file;
+while(@ARGV){
+	$option=shift @ARGV;
+	if($option eq '-ansi'){ $ansi=1; }
+	elsif($option eq '-frames'){ $frames=1; }
+	elsif($option eq '-ppm'){ $ppm=shift @ARGV; }
+	else{ die "Unknown option $option\n"; }
+}
+open(FILE,'<',$file) or die "Can't open $file\n";
+binmode FILE;
+local $/;
+@b=unpack "C*",<FILE>;
+close(FILE);
+
+# Two pages of 80x64 cells, rows are relative to rowOffset like in the videocard
+for($i=0;$i<2*$mx*$my;$i++){
+	$char[$i]=0;
+	$color[$i]=7|(1<<3);
+}
+@palette=(0..7,0..7);
+$rowOffset=0;
+$writePage=0;
+$displayPage=0;
+$cursorX=0;
+$cursorY=0;
+$line=0;
+$pos=0;
+
+sub cell{
+	my($x,$y)=@_;
+	return $writePage*$mx*$my+(($y+$rowOffset)%$my)*$mx+($x%$mx);
+}
+
+# Writes a cell and counts it as redundant when it already showed the same character and color
+sub write{
+	my($x,$y,$c,$col,$type)=@_;
+	my $i=cell($x,$y);
+	$cells{$type}++;
+	$redundant{$type}++ if $char[$i]==$c && $color[$i]==$col;
+	$char[$i]=$c;
+	$color[$i]=$col;
+}
+
+# Next byte of a packet, NOPs within a packet are skipped. A command byte ends the packet, like in the videocard.
+sub next{
+	while($pos<@b && $b[$pos]==0xF0){
+		$pos++;
+		$packetBytes++;
+		$nopBytes++;
+		$nopsInPacket++;
+	}
+	if($pos>=@b || ($b[$pos]>0xF0 && $packetBytes>$nopsInPacket)){
+		$broken=1;
+		return 0;
+	}
+	$packetBytes++;
+	$sum+=$b[$pos];
+	return $b[$pos++];
+}
+
+# NOPs that give the videocard time after a fill, a copy or a scroll of the text engine
+sub nops{
+	while($pos<@b && $b[$pos]==0xF0){
+		$pos++;
+		$packetBytes++;
+		$nopBytes++;
+	}
+}
+
+# Returns 1 when the check byte matches, the videocard ignores most packets when it does not
+sub check{
+	my $expect=$sum&127;
+	my $ok=(&next==$expect && !$broken);
+	$checkErrors++ unless $ok;
+	return $ok;
+}
+
+sub scroll{
+	$rowOffset=($rowOffset+1)%$my;
+	$scrolls++;
+}
+
+sub screen{
+	my($title)=@_;
+	print "--- $title\n";
+	for(my $y=0;$y<$rows;$y++){
+		my $text='';
+		for(my $x=0;$x<$mx;$x++){
+			my $i=$displayPage*$mx*$my+(($y+$frameRowOffset)%$my)*$mx+$x;
+			my $c=($char[$i]>=32 && $char[$i]<=126) ? chr($char[$i]) : ' ';
+			if($ansi){
+				my $fg=$palette[$color[$i]&7];
+				my $bg=$palette[8+(($color[$i]>>3)&7)];
+				# The videocard has red in bit 2 and blue in bit 0, ANSI the other way around
+				my $ansiFg=(($fg&1)<<2)|($fg&2)|(($fg>>2)&1);
+				my $ansiBg=(($bg&1)<<2)|($bg&2)|(($bg>>2)&1);
+				$text.="\e[".(30+$ansiFg).";".(40+$ansiBg)."m$c";
+			}
+			else{
+				$text.=$c;
+			}
+		}
+		$text.="\e[0m" if $ansi;
+		$text=~s/ +$// unless $ansi;
+		print "$text\n";
+	}
+}
+
+$frameRowOffset=0;
+while($pos<@b){
+	$start=$pos;
+	$sum=0;
+	$packetBytes=0;
+	$broken=0;
+	$nopsInPacket=0;
+	if($b[$pos]==0xF0){
+		# NOP between packets
+		$pos++;
+		$packetBytes=1;
+		$nopBytes++;
+		$type='NOP';
+	}
+	elsif($b[$pos]==0xF1){
+		# Marker of the recording, not part of the protocol
+		$line=$b[$pos+1]|($b[$pos+2]<<8);
+		$pos+=3;
+		$lineRuns{$line}++;
+		next;
+	}
+	elsif($b[$pos]<0xF0){
+		$pos++;
+		$packetBytes=1;
+		$type='data';
+		$strayBytes++;
+	}
+	else{
+		$command=&next;
+		$type=$names[$command-0xF0];
+		if($command==0xFF){
+			($x,$y,$c,$col)=(&next,&next,&next,&next);
+			&write($x,$y,$c,$col,'cell') if &check;
+		}
+		elsif($command==0xFC){
+			($x,$y,$col,$n)=(&next,&next,&next,&next);
+			for($k=0;$k<$n;$k++){
+				&write($x+$k,$y,&next,$col,'run');
+			}
+			&check;
+		}
+		elsif($command==0xFE){
+			($x,$y,$w,$h,$c,$col)=(&next,&next,&next,&next,&next,&next);
+			if(&check){
+				for($r=0;$r<$h;$r++){
+					for($k=0;$k<$w;$k++){
+						&write($x+$k,$y+$r,$c,$col,'fill');
+					}
+				}
+			}
+			&nops;
+		}
+		elsif($command==0xFD){
+			&scroll if &check;
+		}
+		elsif($command==0xFB){
+			($col,$n)=(&next,&next);
+			for($k=0;$k<$n;$k++){
+				$c=&next;
+				if($c==13){
+					$cursorX=0;
+					next;
+				}
+				&write($cursorX,$cursorY,$c,$col,'text') if $c!=10;
+				if($c==10 || $cursorX==$mx-1){
+					$cursorX=0;
+					if($cursorY==$rows-1){
+						&scroll;
+						for($q=0;$q<$mx;$q++){
+							$i=cell($q,$rows-1);
+							$char[$i]=0;
+							$color[$i]=$col;
+						}
+						&nops;
+					}
+					else{
+						$cursorY++;
+					}
+				}
+				else{
+					$cursorX++;
+				}
+			}
+			&check;
+		}
+		elsif($command==0xFA){
+			$pages=&next;
+			if(&check){
+				$writePage=$pages&1;
+				$shown=($pages>>1)&1;
+				$frameRowOffset=$rowOffset;
+				&screen("pages at byte $start") if $frames && $shown!=$displayPage;
+				$displayPage=$shown;
+			}
+		}
+		elsif($command==0xF9){
+			($x,$y)=(&next,&next);
+			($cursorX,$cursorY)=($x,$y) if &check;
+		}
+		elsif($command==0xF8){
+			&next;
+			&check;
+		}
+		elsif($command==0xF6){
+			(&next,&next,&next);
+			&check;
+		}
+		elsif($command==0xF5){
+			($x,$y,$w,$h,$tx,$ty)=(&next,&next,&next,&next,&next,&next);
+			if(&check){
+				# Copy through a temporary copy, the videocard picks the direction that gives the same result
+				@copy=();
+				for($r=0;$r<$h;$r++){
+					for($k=0;$k<$w;$k++){
+						$i=cell($x+$k,$y+$r);
+						push @copy,[$char[$i],$color[$i]];
+					}
+				}
+				for($r=0;$r<$h;$r++){
+					for($k=0;$k<$w;$k++){
+						$i=cell($tx+$k,$ty+$r);
+						($char[$i],$color[$i])=@{$copy[$r*$w+$k]};
+					}
+				}
+				$copied+=$w*$h;
+			}
+			&nops;
+		}
+		elsif($command==0xF4){
+			# The first 8 colors are for the foreground, the last 8 for the background
+			for($k=0;$k<16;$k++){
+				$newPalette[$k]=&next&7;
+			}
+			@palette=@newPalette if &check;
+		}
+		else{
+			$type=sprintf "unknown %02X",$command;
+		}
+	}
+	$packets{$type}++;
+	$bytes{$type}+=$packetBytes;
+	$total+=$packetBytes;
+	$lineBytes{$line}+=$packetBytes;
+}
+$frameRowOffset=$rowOffset;
+
+print "bytes=$total\n";
+print "nops=".($nopBytes+0)."\n";
+print "checkerrors=".($checkErrors+0)."\n";
+print "straybytes=".($strayBytes+0)."\n";
+print "scrolls=".($scrolls+0)."\n";
+print "copiedcells=".($copied+0)."\n";
+print "\npacket        count      bytes\n";
+foreach $type (sort { $bytes{$b}<=>$bytes{$a} } keys %bytes){
+	printf "%-10s %8d %10d\n",$type,$packets{$type},$bytes{$type};
+}
+print "\ncells written  cells  redundant\n";
+foreach $type (sort keys %cells){
+	printf "%-10s %10d %10d\n",$type,$cells{$type},$redundant{$type};
+}
+if(%lineRuns){
+	print "\nline      runs      bytes  bytes/run\n";
+	foreach $line (sort { $lineBytes{$b}<=>$lineBytes{$a} } keys %lineBytes){
+		next unless $lineRuns{$line};
+		printf "%5d %9d %10d %10.1f\n",$line,$lineRuns{$line},$lineBytes{$line},$lineBytes{$line}/$lineRuns{$line};
+	}
+}
+&screen('shown at the end');
+
+if(defined $ppm){
+	# The font holds 8 rows per character, bit 0 is the leftmost pixel
+	open(FONT,'<','8x8-font-hex-2.mem') or die "Can't open 8x8-font-hex-2.mem\n";
+	@font=map { hex } split /\s+/,join(' ',<FONT>);
+	close(FONT);
+	@rgb=([0,0,0],[0,0,255],[0,255,0],[0,255,255],[255,0,0],[255,0,255],[255,255,0],[255,255,255]);
+	open(PPM,'>',$ppm) or die "Can't create $ppm\n";
+	binmode PPM;
+	print PPM "P6\n640 480\n255\n";
+	for($py=0;$py<480;$py++){
+		$data='';
+		for($px=0;$px<640;$px++){
+			$i=$displayPage*$mx*$my+((($py>>3)+$frameRowOffset)%$my)*$mx+($px>>3);
+			$c=($char[$i]>=32 && $char[$i]<=127) ? $char[$i] : 32;
+			$on=($font[$c*8+($py&7)]>>($px&7))&1;
+			$shown=$on ? $palette[$color[$i]&7] : $palette[8+(($color[$i]>>3)&7)];
+			$data.=pack "C3",@{$rgb[$shown]};
+		}
+		print PPM $data;
+	}
+	close(PPM);
+}
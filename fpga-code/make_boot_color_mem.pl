@@ -1,11 +1,14 @@
 #!/usr/bin/perl
-$mx=128;
+# Two pages of 80x64 cells
+$pages=2;
+$mx=80;
 $my=64;
-$welcome="Magnatic Basic Computer (C)2020. Please wait while booting...";
 open(FILE,'>bootcolor.mem');
-for($x=0;$x<$mx;$x++){
+for($page=0;$page<$pages;$page++){
 	for($y=0;$y<$my;$y++){
-		print FILE '0F ';
+		for($x=0;$x<$mx;$x++){
+			print FILE '0F ';
+		}
+		print FILE "\n";
 	}
-	print FILE "\n";
 }
@@ -1,17 +1,21 @@
 #!/usr/bin/perl
-$mx=128;
+# Two pages of 80x64 cells, the welcome text is on the first row of page 0
+$pages=2;
+$mx=80;
 $my=64;
 $welcome="Magnatic Basic Computer (C)2020. Please wait while booting...";
 open(FILE,'>bootscreen.mem');
-for($x=0;$x<$mx;$x++){
+for($page=0;$page<$pages;$page++){
 	for($y=0;$y<$my;$y++){
-		if($y==0 && substr($welcome,$x,1)){
-			print FILE unpack "H*",(substr($welcome,$x,1));
+		for($x=0;$x<$mx;$x++){
+			if($page==0 && $y==0 && $x<length($welcome)){
+				print FILE unpack "H*",(substr($welcome,$x,1));
+			}
+			else{
+				print FILE '00';
+			}
+			print FILE " ";
 		}
-		else{
-			print FILE '00';
-		}
-		print FILE " ";
+		print FILE "\n";
 	}
-	print FILE "\n";
 }
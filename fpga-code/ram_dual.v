@@ -3,16 +3,19 @@ module ram_dual(
 		output reg [7:0] colorOut,
 		input [7:0] characterIn,
 		input [7:0]	colorIn,
-		input [12:0] addr_in,
-		input [12:0] addr_out,
+		input [13:0] addr_in,
+		input [13:0] addr_out,
 		input we,
 		input clk1,
-		input clk2
+		input clk2,
+		input [13:0] addr_blit,		// Read by collectData to copy cells while the vga is blanking
+		input blanking
 	);
  
    reg [7:0] q;
-   reg [7:0] characters [8191:0];
-	reg [7:0] colorInfo [8191:0];
+   // Two pages of 80x64 cells, see collectData
+   reg [7:0] characters [10239:0];
+	reg [7:0] colorInfo [10239:0];
 	initial $readmemh("bootscreen.mem",characters);
 	initial $readmemh("bootcolor.mem",colorInfo);
 	
@@ -22,9 +25,11 @@ module ram_dual(
 			colorInfo[addr_in] <= colorIn;
 		end
 			
+   wire [13:0] readAddr = blanking ? addr_blit : addr_out;
+
    always @(negedge clk2) begin
-      characterOut <= characters[addr_out];
-		colorOut <= colorInfo[addr_out];
+      characterOut <= characters[readAddr];
+		colorOut <= colorInfo[readAddr];
 	end
         
 endmodule
@@ -0,0 +1,105 @@
+// Serial link with the ESP, runs on the clock of uart_rx and uart_tx.
+// Sets the baudrate of both uarts and sends the keys and the status of the link to the ESP.
+//   ESP --> FPGA: 0xF8, clocks per bit, check	Sets the baudrate, check as in collectData. Answered with 0xF8 at the
+//																old baudrate, after which both uarts switch. Values below 8 are not answered.
+//   FPGA --> ESP: 0xF8									The baudrate is changed
+//                 0xF7									A packet from the ESP was broken, see collectData
+//                 all other bytes						Keys
+// The baudrate returns to 1843200 while the ESP is not running.
+module serialLink(
+		input clk,
+		input computerRunning,
+		input [7:0] rxData,
+		input rxReady,
+		input [7:0] keyAscii,
+		input keyReady,
+		input linkError,
+		input txActive,
+		input txDone,
+		output reg [7:0] txByte,
+		output reg txValid,
+		output reg [7:0] clksPerBit
+	);
+	localparam BOOT_CLKS_PER_BIT	= 8'd27; // 50 MHz / 27 = 1843200 baud
+	localparam STATUS_BAUD			= 8'hF8;
+	localparam STATUS_ERROR			= 8'hF7;
+
+	localparam RX_IDLE		= 2'd0;
+	localparam RX_DIVISOR	= 2'd1;
+	localparam RX_CHECK		= 2'd2;
+
+	reg [1:0] rxState=RX_IDLE;
+	reg [7:0] newClksPerBit;
+	reg baudPending=1'b0;		// The answer to a baudrate command still has to be sent
+	reg switchPending=1'b0;		// The baudrate changes when the answer has been sent
+	reg errorPending=1'b0;
+	reg keyPending=1'b0;
+	reg [7:0] key;
+
+	// linkError toggles on the clock of collectData
+	reg [2:0] errorSync=3'b000;
+	always @(posedge clk)
+		errorSync<={errorSync[1:0],linkError};
+
+	wire txIdle=!txActive && !txDone && !txValid;
+
+	always @(posedge clk) begin
+		txValid<=1'b0;
+		if(!computerRunning) begin
+			clksPerBit<=BOOT_CLKS_PER_BIT;
+			rxState<=RX_IDLE;
+			baudPending<=1'b0;
+			switchPending<=1'b0;
+			errorPending<=1'b0;
+		end
+		else begin
+			// 0xF0 is skipped, also within a baudrate command, as in collectData
+			if(rxReady && rxData!=8'hF0) begin
+				if(rxData==8'hF8)
+					rxState<=RX_DIVISOR;
+				else if(rxData>=8'hF0)
+					rxState<=RX_IDLE;
+				else if(rxState==RX_DIVISOR) begin
+					newClksPerBit<=rxData;
+					rxState<=RX_CHECK;
+				end
+				else if(rxState==RX_CHECK) begin
+					if(rxData[6:0]==7'h78+newClksPerBit[6:0] && newClksPerBit>=8'd8)
+						baudPending<=1'b1;
+					rxState<=RX_IDLE;
+				end
+			end
+			if(errorSync[2]^errorSync[1])
+				errorPending<=1'b1;
+
+			// Send one byte at a time, the answer to a baudrate command first
+			if(txIdle) begin
+				if(switchPending) begin
+					clksPerBit<=newClksPerBit;
+					switchPending<=1'b0;
+				end
+				else if(baudPending) begin
+					txByte<=STATUS_BAUD;
+					txValid<=1'b1;
+					baudPending<=1'b0;
+					switchPending<=1'b1;
+				end
+				else if(errorPending) begin
+					txByte<=STATUS_ERROR;
+					txValid<=1'b1;
+					errorPending<=1'b0;
+				end
+				else if(keyPending) begin
+					txByte<=key;
+					txValid<=1'b1;
+					keyPending<=1'b0;
+				end
+			end
+		end
+		// A key is kept until it can be sent
+		if(keyReady) begin
+			key<=keyAscii;
+			keyPending<=1'b1;
+		end
+	end
+endmodule
@@ -0,0 +1,936 @@
+`timescale 1ns/1ps
+// Testbench for the path of the bytes from the ESP to the character ram: uart_rx, spi_rx, collectData and ram_dual,
+// with serialLink, uart_tx and vgaOutputNew around them as in asciiVGAVideoCard.bdf.
+// The uarts and serialLink run at 50 MHz, collectData, the ram and the vga at 31.5 MHz, like the two outputs of the pll.
+// The ESP is modelled by tasks that send packets with a bit time that can be off from the divisor of the uart.
+// Every test compares the character ram with the cells that were sent and reports cells/s and the byte error rate.
+// Frames of the vga are written to sim/out as ppm images. Run it with make sim in this directory.
+// With SPI_LINK 1 the bytes go through spi_rx instead of uart_rx, as in the build of the ESP with VIDEO_SPI.
+module tb_videoLink;
+	parameter SPI_LINK = 0;
+
+	reg clk50=1'b0;
+	reg clkVga=1'b0;
+	always #10 clk50=~clk50;
+	always #15.873 clkVga=~clkVga;
+
+	reg rx=1'b1;
+	reg sclk=1'b0;
+	reg mosi=1'b0;
+	reg cs_n=1'b1;
+	reg computerRunning=1'b0;
+
+	wire [7:0] clksPerBit;
+	wire uartRcv;
+	wire [7:0] uartData;
+	wire rcv;
+	wire [7:0] data;
+	wire [13:0] pos;
+	wire writeEnable;
+	wire [7:0] character;
+	wire [7:0] color;
+	wire [5:0] rowOffset;
+	wire displayPage;
+	wire linkError;
+	wire [13:0] cursor;
+	wire [13:0] blitAddr;
+	wire [47:0] palette;
+	wire [7:0] ramCharacter;
+	wire [7:0] ramColor;
+	wire [13:0] characterPos;
+	wire blanking;
+	wire blitWindow;
+	wire [2:0] pixel;
+	wire hsync;
+	wire vsync;
+	wire [7:0] txByte;
+	wire txValid;
+	wire txActive;
+	wire txDone;
+	wire tx;
+
+	uart_rx uartRX(.clk(clk50),.rx(rx),.clksPerBit(clksPerBit),.rcv(uartRcv),.data(uartData));
+	spi_rx #(.SPI_LINK(SPI_LINK)) spiRX(.sclk(sclk),.mosi(mosi),.cs_n(cs_n),.uartRcv(uartRcv),.uartData(uartData),.rcv(rcv),.data(data));
+	collectData collect(.clock(clkVga),.received(data),.ready(rcv),.computerRunning(computerRunning),.pos(pos),
+		.writeEnable(writeEnable),.character(character),.color(color),.rowOffset(rowOffset),.displayPage(displayPage),
+		.linkError(linkError),.cursor(cursor),.blitWindow(blitWindow),.ramCharacter(ramCharacter),.ramColor(ramColor),
+		.blitAddr(blitAddr),.palette(palette));
+	ram_dual ram(.characterOut(ramCharacter),.colorOut(ramColor),.characterIn(character),.colorIn(color),.addr_in(pos),
+		.addr_out(characterPos),.we(writeEnable),.clk1(clkVga),.clk2(clkVga),.addr_blit(blitAddr),.blanking(blanking));
+	vgaOutputNew video(.clk(clkVga),.character(ramCharacter),.fgColor(ramColor[2:0]),.bgColor(ramColor[5:3]),.pixel(pixel),
+		.hsyncOut(hsync),.vsyncOut(vsync),.rowOffset(rowOffset),.displayPage(displayPage),.cursor(cursor),.palette(palette),
+		.characterPos(characterPos),.blanking(blanking),.blitWindow(blitWindow));
+	serialLink link(.clk(clk50),.computerRunning(computerRunning),.rxData(uartData),.rxReady(uartRcv),.keyAscii(8'd0),
+		.keyReady(1'b0),.linkError(linkError),.txActive(txActive),.txDone(txDone),.txByte(txByte),.txValid(txValid),
+		.clksPerBit(clksPerBit));
+	uart_tx uartTX(.i_Clock(clk50),.i_Clks_Per_Bit(clksPerBit),.i_Tx_DV(txValid),.i_Tx_Byte(txByte),.o_Tx_Active(txActive),
+		.o_Tx_Serial(tx),.o_Tx_Done(txDone));
+
+	// The fpga starts with all registers at 0, uart_rx and the sync generator of the vga count on that
+	initial begin
+		uartRX.state=2'd0;
+		video.hvsync.CounterX=10'd0;
+		video.hvsync.CounterY=10'd0;
+	end
+
+	integer failures=0;
+
+	// ESP side
+
+	real bitTime;			// ns per bit sent by the ESP
+	reg [6:0] check;		// Check byte of the packet that is sent
+	reg [7:0] sent [0:65535];
+	integer sentCount=0;
+
+	// clocks is the divisor of the uart, tolerance makes the bits of the ESP longer (0.02) or shorter (-0.02)
+	task setBitTime(input integer clocks, input real tolerance);
+		bitTime=clocks*20.0*(1.0+tolerance);
+	endtask
+
+	task sendUart(input [7:0] b);
+		integer i;
+		begin
+			rx=1'b0;
+			#(bitTime);
+			for(i=0;i<8;i=i+1) begin
+				rx=b[i];
+				#(bitTime);
+			end
+			rx=1'b1;
+			#(bitTime);
+		end
+	endtask
+
+	// Mode 0, most significant bit first. bits is 8 except to break off a byte.
+	real spiHalf;			// ns per half period of the SPI clock
+	task sendSpi(input [7:0] b, input integer bits);
+		integer i;
+		begin
+			for(i=7;i>7-bits;i=i-1) begin
+				mosi=b[i];
+				#(spiHalf);
+				sclk=1'b1;
+				#(spiHalf);
+				sclk=1'b0;
+			end
+		end
+	endtask
+
+	// Over SPI the bytes of a test are sent in one transfer, like a DMA burst of the ESP
+	task sendByte(input [7:0] b);
+		begin
+			sent[sentCount]=b;
+			sentCount=sentCount+1;
+			if(SPI_LINK) begin
+				if(cs_n) begin
+					cs_n=1'b0;
+					#(spiHalf);
+				end
+				sendSpi(b,8);
+			end
+			else
+				sendUart(b);
+		end
+	endtask
+
+	task sendCommand(input [7:0] b);
+		begin
+			check=b[6:0];
+			sendByte(b);
+		end
+	endtask
+
+	task sendData(input [7:0] b);
+		begin
+			check=check+b[6:0];
+			sendByte(b);
+		end
+	endtask
+
+	task sendCheck;
+		sendByte({1'b0,check});
+	endtask
+
+	// Bytes arriving at collectData, compared with the bytes that were sent. A lost byte counts as one error.
+
+	integer receivedCount=0;
+	integer byteErrors=0;
+	always @(posedge rcv) begin
+		#1;
+		if(receivedCount+1<sentCount && data!==sent[receivedCount] && data===sent[receivedCount+1]) begin
+			byteErrors=byteErrors+1;
+			receivedCount=receivedCount+1;
+		end
+		if(receivedCount>=sentCount || data!==sent[receivedCount])
+			byteErrors=byteErrors+1;
+		receivedCount=receivedCount+1;
+	end
+
+	integer linkErrors=0;
+	always @(linkError)
+		if(computerRunning)
+			linkErrors=linkErrors+1;
+
+	// Bytes sent back to the ESP by serialLink, read at the baudrate of uart_tx when the start bit begins
+
+	reg [7:0] answers [0:15];
+	integer answerCount=0;
+	always @(negedge tx)
+		if(computerRunning) begin : readAnswer
+			integer i;
+			real t;
+			reg [7:0] b;
+			t=clksPerBit*20.0;
+			#(t/2);
+			if(tx==1'b0) begin
+				for(i=0;i<8;i=i+1) begin
+					#(t);
+					b[i]=tx;
+				end
+				#(t);
+				answers[answerCount%16]=b;
+				answerCount=answerCount+1;
+			end
+		end
+
+	// Cells that should be in the character ram
+
+	reg [7:0] expChar [0:10239];
+	reg [7:0] expColor [0:10239];
+	reg expSet [0:10239];
+
+	// State of collectData that is expected after the packets that were sent
+	reg [5:0] expOffset;		// rowOffset, the row of the ring of a page that is shown at the top of the screen
+	reg expPage;				// Page that is written
+	reg expDisplay;			// Page that is shown
+	reg [6:0] expCursorX;	// Cursor of the text engine
+	reg [5:0] expCursorY;
+	reg [13:0] expBlink;		// Blinking cursor
+	reg [47:0] expPalette;
+
+	// collectData after computerRunning was low
+	task resetExpected;
+		begin
+			expOffset=6'd0;
+			expPage=1'b0;
+			expDisplay=1'b0;
+			expCursorX=7'd0;
+			expCursorY=6'd0;
+			expBlink=14'd0;
+			expPalette={2{24'o76543210}};
+		end
+	endtask
+
+	// row is a row of the screen, it is stored relative to rowOffset in the page that is written
+	task expectCell(input [5:0] row, input [6:0] column, input [7:0] c, input [7:0] col);
+		integer a;
+		begin
+			a=(expPage ? 5120 : 0)+((row+expOffset)%64)*80+column;
+			expChar[a]=c;
+			expColor[a]=col;
+			expSet[a]=1'b1;
+		end
+	endtask
+
+	real started;
+	integer expectedLinkErrors;
+
+	task startTest(input integer clocks, input real tolerance);
+		integer a;
+		begin
+			for(a=0;a<10240;a=a+1)
+				expSet[a]=1'b0;
+			sentCount=0;
+			receivedCount=0;
+			byteErrors=0;
+			linkErrors=0;
+			expectedLinkErrors=0;
+			setBitTime(clocks,tolerance);
+			if(SPI_LINK)
+				$write("SPI %0.0f MHz: ",500.0/spiHalf);
+			else
+				$write("divisor %0d, bit time %0.1f%%: ",clocks,tolerance*100.0);
+			started=$realtime;
+		end
+	endtask
+
+	// Waits for the last byte, compares the character ram with the expected cells and reports. A test that must pass
+	// fails on any error, the others only report the error rate.
+	task finishTest(input integer cells, input integer mustPass);
+		integer a;
+		integer cellErrors;
+		integer stateErrors;
+		real seconds;
+		begin
+			seconds=($realtime-started)*1.0e-9;
+			cs_n=1'b1;
+			#(bitTime*4);
+			repeat(20) @(posedge clkVga);
+			if(receivedCount<sentCount)
+				byteErrors=byteErrors+sentCount-receivedCount;
+			cellErrors=0;
+			for(a=0;a<10240;a=a+1)
+				if(expSet[a] && (ram.characters[a]!==expChar[a] || ram.colorInfo[a]!==expColor[a]))
+					cellErrors=cellErrors+1;
+			stateErrors=0;
+			if(collect.rowOffset!==expOffset || collect.writePage!==expPage || collect.displayPage!==expDisplay ||
+					collect.cursorX!==expCursorX || collect.cursorY!==expCursorY || collect.cursor!==expBlink ||
+					collect.palette!==expPalette) begin
+				$write("state rowOffset %0d/%0d, pages %b%b/%b%b, text cursor %0d,%0d/%0d,%0d, blink %h/%h, palette %h/%h: ",
+					collect.rowOffset,expOffset,collect.displayPage,collect.writePage,expDisplay,expPage,collect.cursorX,
+					collect.cursorY,expCursorX,expCursorY,collect.cursor,expBlink,collect.palette,expPalette);
+				stateErrors=1;
+			end
+			$write("%0d cells in %0.3f ms, %0.0f cells/s, byte errors %0d of %0d (%0.2f%%), cell errors %0d, link errors %0d",
+				cells,seconds*1000.0,cells/seconds,byteErrors,sentCount,byteErrors*100.0/sentCount,cellErrors,linkErrors);
+			if(!mustPass)
+				$display("");
+			else if(byteErrors==0 && cellErrors==0 && stateErrors==0 && linkErrors==expectedLinkErrors)
+				$display("  PASS");
+			else begin
+				$display("  FAIL");
+				failures=failures+1;
+			end
+		end
+	endtask
+
+	// Tests
+
+	// One cell packet at a random place
+	task sendCell;
+		reg [6:0] x;
+		reg [5:0] y;
+		reg [7:0] c;
+		reg [7:0] col;
+		begin
+			x={$random}%80;
+			y={$random}%60;
+			c={$random}%240;
+			col={$random}%64;
+			sendCommand(8'hFF);
+			sendData(x);
+			sendData(y);
+			sendData(c);
+			sendData(col);
+			sendCheck;
+			expectCell(y,x,c,col);
+		end
+	endtask
+
+	// Single cells at random places, 6 bytes per cell
+	task cellTest(input integer clocks, input real tolerance, input integer cells, input integer mustPass);
+		integer i;
+		begin
+			$write("cells    ");
+			startTest(clocks,tolerance);
+			for(i=0;i<cells;i=i+1)
+				sendCell;
+			finishTest(cells,mustPass);
+		end
+	endtask
+
+	// The whole screen with one cell packet per cell, 28800 bytes
+	task cellScreenTest(input integer clocks, input real tolerance, input integer mustPass);
+		integer x;
+		integer y;
+		reg [7:0] c;
+		reg [7:0] col;
+		begin
+			$write("screen   cells, ");
+			startTest(clocks,tolerance);
+			for(y=0;y<60;y=y+1)
+				for(x=0;x<80;x=x+1) begin
+					c={$random}%240;
+					col={$random}%64;
+					sendCommand(8'hFF);
+					sendData(x);
+					sendData(y);
+					sendData(c);
+					sendData(col);
+					sendCheck;
+					expectCell(y,x,c,col);
+				end
+			finishTest(80*60,mustPass);
+		end
+	endtask
+
+	// One run packet of count cells in one color
+	task sendRun(input [6:0] x, input [5:0] y, input [7:0] col, input [7:0] count, input badCheck);
+		integer i;
+		reg [7:0] c;
+		begin
+			sendCommand(8'hFC);
+			sendData(x);
+			sendData(y);
+			sendData(col);
+			sendData(count);
+			for(i=0;i<count;i=i+1) begin
+				c={$random}%240;
+				sendData(c);
+				expectCell(y,x+i,c,col);
+			end
+			if(badCheck)
+				sendByte({1'b0,check+7'd1});
+			else
+				sendCheck;
+		end
+	endtask
+
+	// The whole screen with one run packet per row, 5160 bytes
+	task runScreenTest(input integer clocks, input real tolerance, input integer mustPass);
+		integer y;
+		begin
+			$write("screen   runs,  ");
+			startTest(clocks,tolerance);
+			for(y=0;y<60;y=y+1)
+				sendRun(7'd0,y,{$random}%64,8'd80,1'b0);
+			finishTest(80*60,mustPass);
+		end
+	endtask
+
+	// Runs of 0 and 1 cells, and a run with a wrong check byte. Its characters stay written and the link error
+	// is reported.
+	task runEdgeTest(input integer clocks);
+		begin
+			$write("runs     short and broken, ");
+			startTest(clocks,0.0);
+			sendRun(7'd3,6'd2,8'h05,8'd0,1'b0);
+			sendRun(7'd79,6'd59,8'h06,8'd1,1'b0);
+			sendRun(7'd10,6'd5,8'h07,8'd3,1'b1);
+			expectedLinkErrors=1;
+			finishTest(4,1);
+		end
+	endtask
+
+	// With nops a 0xF0 follows the command and the divisor, serialLink skips it as collectData does
+	task sendBaud(input [7:0] divisor, input badCheck, input nops);
+		begin
+			sendCommand(8'hF8);
+			if(nops)
+				sendByte(8'hF0);
+			sendData(divisor);
+			if(nops)
+				sendByte(8'hF0);
+			if(badCheck)
+				sendByte({1'b0,check+7'd1});
+			else
+				sendCheck;
+		end
+	endtask
+
+	// Checks the answers of serialLink to what was sent since answersBefore, answered is 0 or 1
+	task checkAnswer(input integer answersBefore, input integer answered, input [7:0] answer, input [7:0] divisor);
+		begin
+			#(bitTime*40);
+			if(answerCount-answersBefore!=answered)
+				$write("%0d answers",answerCount-answersBefore);
+			else if(answered)
+				$write("answer %h",answers[(answerCount-1)%16]);
+			else
+				$write("no answer");
+			$write(", divisor %0d",clksPerBit);
+			if(answerCount-answersBefore==answered && (answered==0 || answers[(answerCount-1)%16]==answer) &&
+					clksPerBit==divisor)
+				$display("  PASS");
+			else begin
+				$display("  FAIL");
+				failures=failures+1;
+			end
+		end
+	endtask
+
+	// The baudrate command 0xF8 at the current baudrate. A wrong check byte is a link error, which serialLink reports
+	// with 0xF7. A divisor below 8 is ignored. Otherwise serialLink answers 0xF8 at the old baudrate and then switches.
+	task baudTest(input [7:0] divisor, input badCheck, input nops, input integer answered, input [7:0] answer,
+			input [7:0] newDivisor);
+		integer before;
+		begin
+			if(badCheck)
+				$write("baud     divisor %0d with a wrong check byte: ",divisor);
+			else if(nops)
+				$write("baud     divisor %0d with 0xF0 in between: ",divisor);
+			else
+				$write("baud     divisor %0d: ",divisor);
+			before=answerCount;
+			setBitTime(clksPerBit,0.0);
+			sendBaud(divisor,badCheck,nops);
+			checkAnswer(before,answered,answer,newDivisor);
+		end
+	endtask
+
+	// A cell packet with a wrong check byte is reported with 0xF7 at the current baudrate
+	task linkErrorTest;
+		integer before;
+		begin
+			$write("error    cell with a wrong check byte at divisor %0d: ",clksPerBit);
+			before=answerCount;
+			setBitTime(clksPerBit,0.0);
+			sendCommand(8'hFF);
+			sendData(8'd1);
+			sendData(8'd1);
+			sendData(8'h41);
+			sendData(8'h07);
+			sendByte({1'b0,check+7'd1});
+			checkAnswer(before,1,8'hF7,clksPerBit);
+		end
+	endtask
+
+	// cs_n going high in the middle of a byte drops its bits, the next transfer starts on a byte boundary
+	task spiFrameTest;
+		begin
+			$write("spi      cs_n high within a byte, ");
+			startTest(27,0.0);
+			cs_n=1'b0;
+			#(spiHalf);
+			sendSpi(8'hFF,3);
+			cs_n=1'b1;
+			#(spiHalf*4);
+			sendCommand(8'hFF);
+			sendData(8'd40);
+			sendData(8'd30);
+			sendData(8'h42);
+			sendData(8'h0C);
+			sendCheck;
+			expectCell(6'd30,7'd40,8'h42,8'h0C);
+			finishTest(1,1);
+		end
+	endtask
+
+	// NOPs that give collectData clocks to fill or copy, as many as the ESP sends in host_serialFillVideocard
+	task sendPadding(input integer clocks);
+		integer cellsPerByte;
+		integer i;
+		begin
+			if(SPI_LINK)
+				cellsPerByte=31500000/($rtoi(500.0e6/spiHalf)/8)*15/16;
+			else
+				cellsPerByte=31500000/(50000000/clksPerBit/10)*15/16;
+			for(i=clocks/cellsPerByte+1;i>0;i=i-1)
+				sendByte(8'hF0);
+		end
+	endtask
+
+	task sendEnd(input badCheck);
+		begin
+			if(badCheck)
+				sendByte({1'b0,check+7'd1});
+			else
+				sendCheck;
+		end
+	endtask
+
+	task sendFill(input [6:0] x, input [5:0] y, input [6:0] width, input [5:0] height, input [7:0] c, input [7:0] col,
+			input badCheck);
+		integer i;
+		integer j;
+		begin
+			sendCommand(8'hFE);
+			sendData(x);
+			sendData(y);
+			sendData(width);
+			sendData(height);
+			sendData(c);
+			sendData(col);
+			sendEnd(badCheck);
+			if(!badCheck)
+				for(j=0;j<height;j=j+1)
+					for(i=0;i<width;i=i+1)
+						expectCell(y+j,x+i,c,col);
+			sendPadding(width*height);
+		end
+	endtask
+
+	// Rectangles of 0xFE, each followed by the NOPs for the time of the fill. An empty rectangle and a fill with a
+	// wrong check byte change nothing.
+	task fillTest(input integer clocks);
+		begin
+			$write("fill     ");
+			startTest(clocks,0.0);
+			sendFill(7'd0,6'd0,7'd80,6'd60,8'h20,8'h07,1'b0);
+			sendFill(7'd10,6'd5,7'd20,6'd8,8'h41,8'h1C,1'b0);
+			sendFill(7'd79,6'd59,7'd1,6'd1,8'h42,8'h05,1'b0);
+			sendFill(7'd30,6'd30,7'd0,6'd5,8'h43,8'h06,1'b0);
+			sendFill(7'd40,6'd40,7'd5,6'd5,8'h44,8'h06,1'b1);
+			sendCell;
+			expectedLinkErrors=1;
+			finishTest(80*60+20*8+1+1,1);
+		end
+	endtask
+
+	task sendScroll(input badCheck);
+		begin
+			sendCommand(8'hFD);
+			sendEnd(badCheck);
+			if(!badCheck)
+				expOffset=expOffset+6'd1;
+		end
+	endtask
+
+	// 0xFD 70 times, so rowOffset wraps around the 64 rows of the page. A new bottom row is written after each scroll,
+	// the rows that were written before stay in their place in the ring.
+	task scrollTest(input integer clocks);
+		integer i;
+		begin
+			$write("scroll   ");
+			startTest(clocks,0.0);
+			for(i=0;i<70;i=i+1) begin
+				sendScroll(1'b0);
+				sendRun(7'd0,6'd59,{$random}%64,8'd80,1'b0);
+			end
+			sendScroll(1'b1);
+			sendRun(7'd0,6'd0,8'h07,8'd80,1'b0);
+			expectedLinkErrors=1;
+			finishTest(71*80,1);
+		end
+	endtask
+
+	task sendCursor(input [6:0] x, input [5:0] y, input badCheck);
+		begin
+			sendCommand(8'hF9);
+			sendData(x);
+			sendData(y);
+			sendEnd(badCheck);
+			if(!badCheck) begin
+				expCursorX=x;
+				expCursorY=y;
+			end
+		end
+	endtask
+
+	// The text engine of collectData for one character. Moving down from the last row scrolls and clears the new
+	// bottom row, for which the ESP puts NOPs in the packet.
+	task textCharacter(input [7:0] c, input [7:0] col);
+		integer i;
+		begin
+			if(c==8'd13)
+				expCursorX=7'd0;
+			else begin
+				if(c!=8'd10)
+					expectCell(expCursorY,expCursorX,c,col);
+				if(c==8'd10 || expCursorX==7'd79) begin
+					expCursorX=7'd0;
+					if(expCursorY==6'd59) begin
+						expOffset=expOffset+6'd1;
+						for(i=0;i<80;i=i+1)
+							expectCell(6'd59,i,8'd0,col);
+						sendPadding(80);
+					end
+					else
+						expCursorY=expCursorY+6'd1;
+				end
+				else
+					expCursorX=expCursorX+7'd1;
+			end
+		end
+	endtask
+
+	// A text packet of count characters, with a new line or a carriage return now and then. The characters are written
+	// as they arrive, also when the check byte turns out to be wrong.
+	task sendText(input [7:0] col, input [7:0] count, input badCheck);
+		integer i;
+		reg [7:0] c;
+		begin
+			sendCommand(8'hFB);
+			sendData(col);
+			sendData(count);
+			for(i=0;i<count;i=i+1) begin
+				if(i%41==40)
+					c=8'd10;
+				else if(i%67==66)
+					c=8'd13;
+				else
+					c=8'd32+{$random}%200;
+				sendData(c);
+				textCharacter(c,col);
+			end
+			sendEnd(badCheck);
+		end
+	endtask
+
+	// 0xF9 and 0xFB: wrapping at the end of a row, new lines and carriage returns, scrolling from the last row and
+	// packets with a wrong check byte
+	task textTest(input integer clocks);
+		begin
+			$write("text     ");
+			startTest(clocks,0.0);
+			sendCursor(7'd70,6'd10,1'b0);
+			sendText(8'h0E,8'd30,1'b0);
+			sendCursor(7'd0,6'd57,1'b0);
+			sendText(8'h07,8'd230,1'b0);
+			sendText(8'h3A,8'd230,1'b0);
+			sendCursor(7'd5,6'd5,1'b1);
+			sendText(8'h0C,8'd20,1'b1);
+			expectedLinkErrors=2;
+			finishTest(30+230+230+20,1);
+		end
+	endtask
+
+	reg [7:0] copyChar [0:4799];
+	reg [7:0] copyColor [0:4799];
+
+	// A copy within the page that is written, followed by the NOPs the ESP sends in host_serialCopyVideocard
+	task sendCopy(input [6:0] x, input [5:0] y, input [6:0] width, input [5:0] height, input [6:0] toX, input [5:0] toY,
+			input badCheck);
+		integer i;
+		integer j;
+		integer a;
+		begin
+			sendCommand(8'hF5);
+			sendData(x);
+			sendData(y);
+			sendData(width);
+			sendData(height);
+			sendData(toX);
+			sendData(toY);
+			sendEnd(badCheck);
+			if(!badCheck) begin
+				for(j=0;j<height;j=j+1)
+					for(i=0;i<width;i=i+1) begin
+						a=(expPage ? 5120 : 0)+((y+j+expOffset)%64)*80+x+i;
+						copyChar[j*80+i]=expChar[a];
+						copyColor[j*80+i]=expColor[a];
+					end
+				for(j=0;j<height;j=j+1)
+					for(i=0;i<width;i=i+1)
+						expectCell(toY+j,toX+i,copyChar[j*80+i],copyColor[j*80+i]);
+			end
+			sendPadding(width*height*5+841);
+		end
+	endtask
+
+	// 0xF5 with rectangles that overlap in all four directions, a rectangle of whole rows and a wrong check byte
+	task copyTest(input integer clocks);
+		integer y;
+		begin
+			$write("copy     ");
+			startTest(clocks,0.0);
+			for(y=0;y<60;y=y+1)
+				sendRun(7'd0,y,{$random}%64,8'd80,1'b0);
+			sendCopy(7'd10,6'd10,7'd30,6'd10,7'd20,6'd15,1'b0);
+			sendCopy(7'd20,6'd15,7'd30,6'd10,7'd5,6'd12,1'b0);
+			sendCopy(7'd40,6'd30,7'd20,6'd20,7'd45,6'd25,1'b0);
+			sendCopy(7'd45,6'd25,7'd20,6'd20,7'd41,6'd33,1'b0);
+			sendCopy(7'd0,6'd0,7'd80,6'd5,7'd0,6'd2,1'b0);
+			sendCopy(7'd0,6'd50,7'd10,6'd10,7'd70,6'd0,1'b1);
+			sendCell;
+			expectedLinkErrors=1;
+			finishTest(300+300+400+400+400+1,1);
+		end
+	endtask
+
+	task sendPages(input writePage, input displayPage, input badCheck);
+		begin
+			sendCommand(8'hFA);
+			sendData({displayPage,writePage});
+			sendEnd(badCheck);
+			if(!badCheck) begin
+				expPage=writePage;
+				expDisplay=displayPage;
+			end
+		end
+	endtask
+
+	// 0xFA: cells written to page 1 while page 0 is shown, then page 1 is shown while page 0 is written
+	task pageTest(input integer clocks);
+		integer i;
+		begin
+			$write("pages    ");
+			startTest(clocks,0.0);
+			sendPages(1'b1,1'b0,1'b0);
+			for(i=0;i<60;i=i+1)
+				sendRun(7'd0,i,{$random}%64,8'd80,1'b0);
+			sendPages(1'b0,1'b1,1'b0);
+			for(i=0;i<50;i=i+1)
+				sendCell;
+			sendPages(1'b1,1'b1,1'b1);
+			sendCell;
+			expectedLinkErrors=1;
+			finishTest(60*80+51,1);
+		end
+	endtask
+
+	task sendBlink(input [6:0] x, input [5:0] y, input on, input badCheck);
+		begin
+			sendCommand(8'hF6);
+			sendData(x);
+			sendData(y);
+			sendData(on);
+			sendEnd(badCheck);
+			if(!badCheck)
+				expBlink={on,y,x};
+		end
+	endtask
+
+	// 0xF6 turns the blinking cursor on and off
+	task blinkTest(input integer clocks);
+		begin
+			$write("blink    ");
+			startTest(clocks,0.0);
+			sendBlink(7'd12,6'd34,1'b1,1'b0);
+			sendBlink(7'd1,6'd2,1'b0,1'b0);
+			sendBlink(7'd79,6'd59,1'b1,1'b0);
+			sendBlink(7'd3,6'd3,1'b0,1'b1);
+			expectedLinkErrors=1;
+			finishTest(0,1);
+		end
+	endtask
+
+	task sendPalette(input [47:0] colors, input badCheck);
+		integer i;
+		begin
+			sendCommand(8'hF4);
+			for(i=0;i<16;i=i+1)
+				sendData(colors[i*3+:3]);
+			sendEnd(badCheck);
+			if(!badCheck)
+				expPalette=colors;
+		end
+	endtask
+
+	// 0xF4 with the foreground colors reversed and a blue background, then one with a wrong check byte
+	task paletteTest(input integer clocks);
+		begin
+			$write("palette  ");
+			startTest(clocks,0.0);
+			sendPalette({{8{3'o1}},24'o01234567},1'b0);
+			sendPalette({2{24'o76543210}},1'b1);
+			expectedLinkErrors=1;
+			finishTest(0,1);
+		end
+	endtask
+
+	// The packets other than cells and runs, the frames show page 1 with the blinking cursor and the palette
+	task packetTests(input integer clocks);
+		begin
+			fillTest(clocks);
+			scrollTest(clocks);
+			textTest(clocks);
+			copyTest(clocks);
+			pageTest(clocks);
+			blinkTest(clocks);
+			paletteTest(clocks);
+		end
+	endtask
+
+	// Writes one frame of the vga as a ppm image, bit 2 of a pixel is red, bit 1 green and bit 0 blue
+	task renderFrame(input [8*32-1:0] fileName);
+		integer f;
+		integer n;
+		integer unknown;
+		reg shown;
+		begin
+			@(posedge clkVga);
+			#1;
+			while(video.counterX!=10'd0 || video.counterY!=10'd0) begin
+				@(posedge clkVga);
+				#1;
+			end
+			// pixel follows inDisplayArea one clock later
+			f=$fopen(fileName,"w");
+			$fwrite(f,"P3\n640 480\n1\n");
+			n=0;
+			unknown=0;
+			shown=1'b0;
+			while(n<640*480) begin
+				@(posedge clkVga);
+				#1;
+				if(shown) begin
+					if(^pixel===1'bx)
+						unknown=unknown+1;
+					$fwrite(f,"%0d %0d %0d\n",pixel[2],pixel[1],pixel[0]);
+					n=n+1;
+				end
+				shown=video.inDisplayArea;
+			end
+			$fclose(f);
+			$write("frame    %0s",fileName);
+			if(unknown==0)
+				$display("  PASS");
+			else begin
+				$display(", %0d unknown pixels  FAIL",unknown);
+				failures=failures+1;
+			end
+		end
+	endtask
+
+	task uartTests;
+		begin
+			// 1843200 baud after booting, with the clock of the ESP exact and 2% off
+			cellTest(27,0.0,200,1);
+			cellTest(27,0.02,200,0);
+			cellTest(27,-0.02,200,0);
+			renderFrame("sim/out/cells.ppm");
+
+			// Bytes and time for a full screen, cell by cell and with the run packet
+			cellScreenTest(27,0.0,1);
+			runScreenTest(27,0.0,1);
+			runEdgeTest(27);
+			renderFrame("sim/out/runs.ppm");
+
+			// Switch to 5000000 baud like the ESP does after booting, then the same tests at the new baudrate
+			baudTest(8'd10,1'b1,1'b0,1,8'hF7,8'd27);
+			baudTest(8'd7,1'b0,1'b0,0,8'h00,8'd27);
+			baudTest(8'd10,1'b0,1'b1,1,8'hF8,8'd10);
+			cellTest(10,0.0,200,1);
+			cellTest(10,0.02,200,0);
+			cellTest(10,-0.02,200,0);
+			runScreenTest(10,0.0,1);
+			linkErrorTest;
+			packetTests(10);
+			renderFrame("sim/out/packets.ppm");
+
+			// The uarts return to the boot baudrate while the ESP is not running
+			computerRunning=1'b0;
+			repeat(10) @(posedge clk50);
+			computerRunning=1'b1;
+			resetExpected;
+			repeat(10) @(posedge clk50);
+			$write("baud     after a restart of the ESP: divisor %0d",clksPerBit);
+			if(clksPerBit==8'd27)
+				$display("  PASS");
+			else begin
+				$display("  FAIL");
+				failures=failures+1;
+			end
+			cellTest(27,0.0,100,1);
+		end
+	endtask
+
+	// 20 MHz as VIDEO_SPI_FREQUENCY in the ESP and 40 MHz, the most spi_rx is meant for
+	task spiTests;
+		begin
+			spiHalf=25.0;
+			cellTest(27,0.0,200,1);
+			runScreenTest(27,0.0,1);
+			spiHalf=12.5;
+			cellTest(27,0.0,200,1);
+			runScreenTest(27,0.0,1);
+			spiFrameTest;
+			renderFrame("sim/out/spi.ppm");
+			packetTests(27);
+			renderFrame("sim/out/spi_packets.ppm");
+		end
+	endtask
+
+	initial begin
+		if(SPI_LINK)
+			$display("SPI link from the ESP to the character ram");
+		else
+			$display("Serial link from the ESP to the character ram");
+		resetExpected;
+		repeat(10) @(posedge clk50);
+		computerRunning=1'b1;
+		repeat(10) @(posedge clk50);
+
+		if(SPI_LINK)
+			spiTests;
+		else
+			uartTests;
+
+		if(failures==0)
+			$display("All tests passed");
+		else
+			$display("FAILED: %0d tests",failures);
+		$finish;
+	end
+endmodule
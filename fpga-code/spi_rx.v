@@ -0,0 +1,42 @@
+// SPI slave receiver, mode 0 and most significant bit first, as an alternative to uart_rx for the bytes from the ESP.
+// The shift register runs on the SPI clock of the ESP, so the SPI clock is not limited by the clock of the videocard.
+// collectData needs about 4 of its clocks per byte, which allows an SPI clock of up to 40 MHz.
+// rcv rises when a byte is complete and stays high for 4 SPI clocks or until cs_n goes high. data stays valid until
+// the next byte is complete. A high cs_n resets the bit counter, so every transfer from the ESP starts on a byte boundary.
+// With SPI_LINK 0 the bytes of the uart are passed through, so the same design works for both builds of the ESP.
+module spi_rx #(
+		parameter SPI_LINK = 0
+	)(
+		input sclk,
+		input mosi,
+		input cs_n,
+		input uartRcv,
+		input [7:0] uartData,
+		output rcv,
+		output [7:0] data
+	);
+	reg [2:0] bitCount=3'd0;
+	reg [6:0] shift;
+	reg spiRcv=1'b0;
+	reg [7:0] spiData;
+
+	always @(posedge sclk or posedge cs_n) begin
+		if(cs_n) begin
+			bitCount<=3'd0;
+			spiRcv<=1'b0;
+		end
+		else begin
+			shift<={shift[5:0],mosi};
+			bitCount<=bitCount+3'd1;
+			if(bitCount==3'd7) begin
+				spiData<={shift,mosi};
+				spiRcv<=1'b1;
+			end
+			else if(bitCount==3'd3)
+				spiRcv<=1'b0;
+		end
+	end
+
+	assign rcv=SPI_LINK ? spiRcv : uartRcv;
+	assign data=SPI_LINK ? spiData : uartData;
+endmodule
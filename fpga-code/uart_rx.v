@@ -17,11 +17,10 @@
 
 
 //-- Serial receiver unit module
-module uart_rx #(
-         parameter BAUDRATE = 27   //-- Default baudrate
-)(
+module uart_rx(
          input wire clk,         //-- System clock (12MHz in the ICEstick)
          input wire rx,          //-- Serial data input
+         input wire [7:0] clksPerBit, //-- Baudrate divisor, set by serialLink
          output reg rcv,         //-- Data is available (1)
          output reg [7:0] data   //-- Data received
 );
@@ -47,9 +46,10 @@ always @(posedge clk)
   rx_r <= rx;
 
 //-- Baud generator
-baudgen_rx #(BAUDRATE)
+baudgen_rx
   baudgen0 (
     .clk(clk),
+    .divisor(clksPerBit),
     .clk_ena(bauden),
     .clk_out(clk_baud)
   );
@@ -83,7 +83,6 @@ always @(posedge clk)
 //-- Receiver states
 localparam IDLE = 2'd0;  //-- IDLEde reposo
 localparam RECV = 2'd1;  //-- Receiving data
-localparam LOAD = 2'd2;  //-- Storing the character received
 localparam DAV = 2'd3;   //-- Data is available
 
 //-- fsm states
@@ -95,7 +94,7 @@ always @(posedge clk)
     state <= next_state;
 
 //-- Control signal generation and next states
-always @(posedge clk) begin
+always @(*) begin
 
   //-- Default values
   next_state = state;      //-- Stay in the same state by default
@@ -115,19 +114,16 @@ always @(posedge clk) begin
     end
 
     //-- Receiving state
-    //-- Turn on the baud generator and wait for the serial package to be received
+    //-- Turn on the baud generator and wait for the serial package to be received.
+    //-- The character is stored in the data register right away, so that the receiver
+    //-- is back in IDLE before the next start bit of a sender that is up to 2% fast
     RECV: begin
       bauden = 1;
       rcv = 0;
-      if (bitc == 4'd10)
-        next_state = LOAD;
-    end
-
-    //-- Store the received character in the data register (1 cycle)
-    LOAD: begin
-      load = 1;
-      //rcv = 0;
-      next_state = DAV;
+      if (bitc == 4'd10) begin
+        load = 1;
+        next_state = DAV;
+      end
     end
 
     //-- Data Available (1 cycle)
@@ -136,8 +132,10 @@ always @(posedge clk) begin
       next_state = IDLE;
     end
 
-    default:
+    default: begin
       rcv = 0;
+      next_state = IDLE;
+    end
 
   endcase
 
@@ -6,15 +6,16 @@
 // and no parity bit.  When transmit is complete o_Tx_done will be
 // driven high for one clock cycle.
 //
-// Set Parameter CLKS_PER_BIT as follows:
-// CLKS_PER_BIT = (Frequency of i_Clock)/(Frequency of UART)
+// Set input i_Clks_Per_Bit as follows:
+// i_Clks_Per_Bit = (Frequency of i_Clock)/(Frequency of UART)
 // Example: 10 MHz Clock, 115200 baud UART
 // (10000000)/(115200) = 87
+// It is set by serialLink and only changed while no byte is sent.
   
 module uart_tx 
-  #(parameter CLKS_PER_BIT = 27)
   (
    input       i_Clock,
+   input [7:0] i_Clks_Per_Bit,
    input       i_Tx_DV,
    input [7:0] i_Tx_Byte, 
    output      o_Tx_Active,
@@ -62,8 +63,8 @@ module uart_tx
           begin
             o_Tx_Serial <= 1'b0;
              
-            // Wait CLKS_PER_BIT-1 clock cycles for start bit to finish
-            if (r_Clock_Count < CLKS_PER_BIT-1)
+            // Wait i_Clks_Per_Bit-1 clock cycles for start bit to finish
+            if (r_Clock_Count < i_Clks_Per_Bit-1)
               begin
                 r_Clock_Count <= r_Clock_Count + 1;
                 r_SM_Main     <= s_TX_START_BIT;
@@ -76,12 +77,12 @@ module uart_tx
           end // case: s_TX_START_BIT
          
          
-        // Wait CLKS_PER_BIT-1 clock cycles for data bits to finish         
+        // Wait i_Clks_Per_Bit-1 clock cycles for data bits to finish         
         s_TX_DATA_BITS :
           begin
             o_Tx_Serial <= r_Tx_Data[r_Bit_Index];
              
-            if (r_Clock_Count < CLKS_PER_BIT-1)
+            if (r_Clock_Count < i_Clks_Per_Bit-1)
               begin
                 r_Clock_Count <= r_Clock_Count + 1;
                 r_SM_Main     <= s_TX_DATA_BITS;
@@ -110,8 +111,8 @@ module uart_tx
           begin
             o_Tx_Serial <= 1'b1;
              
-            // Wait CLKS_PER_BIT-1 clock cycles for Stop bit to finish
-            if (r_Clock_Count < CLKS_PER_BIT-1)
+            // Wait i_Clks_Per_Bit-1 clock cycles for Stop bit to finish
+            if (r_Clock_Count < i_Clks_Per_Bit-1)
               begin
                 r_Clock_Count <= r_Clock_Count + 1;
                 r_SM_Main     <= s_TX_STOP_BIT;
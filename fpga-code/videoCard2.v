@@ -52,7 +52,13 @@ module vgaOutputNew(
 		output reg [2:0] pixel,
 		output hsyncOut,
 		output vsyncOut,
-		output [12:0] characterPos
+		input [5:0] rowOffset,		// Row of the character ram at the top of the screen, set by collectData
+		input displayPage,			// Page of the character ram that is shown, set by collectData
+		input [13:0] cursor,			// Blinking cursor, set by collectData: bit 13 shows it, bits 12..7 are the row, 6..0 the column
+		input [47:0] palette,		// Colors shown for the foreground and background colors of a cell, set by collectData
+		output [13:0] characterPos,
+		output blanking,				// The character ram is not read for the screen, its read port is free
+		output blitWindow				// collectData may use the read port during the next clock
 	);
 
     wire inDisplayArea;
@@ -74,8 +80,38 @@ module vgaOutputNew(
       .inDisplayArea(inDisplayArea)
     );
 	 
-	 assign characterPos[12:6]=counterX[9:3];
-	 assign characterPos[5:0]=counterY[8:3];
+	 // rowOffset, displayPage and palette are taken over below the visible area, so a scroll, a page flip or a new
+	 // palette never changes the screen halfway a frame
+	 reg [5:0] frameRowOffset=6'd0;
+	 reg frameDisplayPage=1'b0;
+	 reg [47:0] framePalette={24'o76543210,24'o76543210};
+	 always @(posedge clk)
+		if(counterY==480) begin
+			frameRowOffset<=rowOffset;
+			frameDisplayPage<=displayPage;
+			framePalette<=palette;
+		end
+	 wire [2:0] fgShown=framePalette[fgColor*3 +: 3];
+	 wire [2:0] bgShown=framePalette[24+bgColor*3 +: 3];
+
+	 // The cursor is shown as an underline in the foreground color, 32 frames on and 32 frames off
+	 reg [5:0] blinkCounter=6'd0;
+	 always @(posedge clk)
+		if(counterY==480 && counterX==0)
+			blinkCounter<=blinkCounter+6'd1;
+
+	 // The character ram answers one clock later, so the pixel that is drawn belongs to the previous column.
+	 // The cell is read for that column too, otherwise the last pixel of a cell would come from the next one.
+	 wire [9:0] drawX=counterX-10'd1;
+	 wire cursorHere=cursor[13] && !blinkCounter[5] && counterY[8:3]==cursor[12:7] && drawX[9:3]==cursor[6:0] && counterY[2:0]==3'd7;
+
+	 // The read port is free from the clock after the last pixel until the end of the line, and during the lines
+	 // below the visible area. blitWindow keeps a few clocks away from the edges, collectData sees it one clock late.
+	 assign blanking=(counterX>=641) || (counterY>=480);
+	 assign blitWindow=(counterX>=644 && counterX<836) || (counterY>=480 && counterY<500);
+
+	 wire [5:0] row=counterY[8:3]+frameRowOffset;
+	 assign characterPos=(frameDisplayPage ? 14'd5120 : 14'd0)+{row,6'b000000}+{row,4'b0000}+drawX[9:3];
 
 	always @(posedge clk)
     begin
@@ -84,7 +120,7 @@ module vgaOutputNew(
 		  fontAddress[10:3]=(character>=32 && character<=127) ? character : 32;
 		  fontAddress[2:0]=counterY[2:0];
 		  fontRow=fontRom[fontAddress];
-        pixel <= fontRow[fontPixel] ? fgColor : bgColor;
+        pixel <= (fontRow[fontPixel] || cursorHere) ? fgShown : bgShown;
 		end
       else // if it's not to display, go dark
         pixel <= 3'b000;